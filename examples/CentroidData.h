@@ -35,6 +35,11 @@ struct CentroidData {
   };
   Real max_rad = 0.0;
   std::vector<PerParticleStruct> pps;
+#ifdef HEXADECAPOLE
+  // Local expansion about multipoles.cm, scaled by multipoles.radius.
+  // Only filled in by the FMM dual traversal; not summed or pupped.
+  FLOCR local = {};
+#endif
 
   CentroidData() = default;
   /// Construct centroid from particles.
@@ -75,12 +80,17 @@ struct CentroidData {
   CentroidData& operator=(const CentroidData&) = default;
 
   void pup(PUP::er& p) {
+    pupExport(p, paratreet::eExportAll);
+  }
+
+  // Remote caches get the per-particle smoothing data only if asked for
+  void pupExport(PUP::er& p, unsigned fields) {
     p | multipoles;
     p | box;
     p | count;
     p | size_sm;
     p | max_rad;
-    int num_leaves = pps.size();
+    int num_leaves = (fields & paratreet::eExportNodeSmoothing) ? pps.size() : 0;
     p | num_leaves;
     if (p.isUnpacking()) pps.resize(num_leaves);
     for (int i = 0; i < num_leaves; i++) {
@@ -0,0 +1,97 @@
+#ifndef PARATREET_GRAVITYFMMVISITOR_H_
+#define PARATREET_GRAVITYFMMVISITOR_H_
+
+#include "GravityVisitor.h"
+
+/// Dual-tree gravity with local expansions (FMM). Well separated
+/// cell-cell pairs are converted into the target's local expansion (M2L);
+/// after the traversal DualTraverser shifts the expansions down the Subtree
+/// (L2L) and evaluates them at the leaves' particles (L2P).
+/// Needs the HEXADECAPOLE moments.
+class GravityFmmVisitor : public GravityVisitor {
+public:
+  static constexpr const bool TargetMustBeLeaf = false;
+  static constexpr const bool UseLocalExpansion = true;
+  GravityFmmVisitor() = default;
+  GravityFmmVisitor(Vector3D<Real> offseti, Real thetai) :
+    GravityVisitor(offseti, thetai), theta(thetai)
+  {}
+
+  void pup(PUP::er& p) {
+    GravityVisitor::pup(p);
+    p | theta;
+  }
+
+private:
+  Real theta = 0;
+
+  static Real extent(const CentroidData& data) {
+    return data.count > 1 ? data.multipoles.radius : 0;
+  }
+
+  /// Symmetric acceptance criterion for cell-cell interactions: both
+  /// expansions must converge over the other cell.
+  bool wellSeparated(const SpatialNode<CentroidData>& source, SpatialNode<CentroidData>& target) {
+    if (source.data.count <= nMinParticleNode) return false;
+    if (openSoftening(source.data, target.data)) return false;
+    Vector3D<Real> r = source.data.multipoles.cm + offset - target.data.multipoles.cm;
+    Real reach = extent(source.data) + extent(target.data);
+    return reach * reach < theta * theta * r.lengthSquared();
+  }
+
+public:
+  bool open(const SpatialNode<CentroidData>& source, SpatialNode<CentroidData>& target) {
+    return !wellSeparated(source, target);
+  }
+
+  bool cell(const SpatialNode<CentroidData>& source, SpatialNode<CentroidData>& target) {
+    if (wellSeparated(source, target)) return false;
+    return GravityVisitor::cell(source, target);
+  }
+
+  /// @brief M2L: adds source's multipole to target's local expansion.
+  void node(const SpatialNode<CentroidData>& source, SpatialNode<CentroidData>& target) {
+    if (source.data.count == 0) return;
+#ifdef HEXADECAPOLE
+    auto& m = source.data.multipoles;
+    Vector3D<Real> r = target.data.multipoles.cm - m.cm - offset;
+    Real dir = 1.0 / r.length();
+    FMOMR mom = m.mom;
+    Real tax, tay, taz;
+    momFlocrAddFmomr5cm(&target.data.local, target.data.multipoles.radius, &mom, m.getRadius(),
+                        dir, r.x, r.y, r.z, &tax, &tay, &taz);
+#else
+    CkAbort("GravityFmmVisitor needs HEXADECAPOLE");
+#endif
+  }
+
+  /// @brief L2L: shifts parent's local expansion to child's center.
+  void shiftLocal(const SpatialNode<CentroidData>& parent, SpatialNode<CentroidData>& child) {
+#ifdef HEXADECAPOLE
+    FLOCR shifted = parent.data.local;
+    Real parent_scale = parent.data.multipoles.radius, child_scale = child.data.multipoles.radius;
+    Vector3D<Real> r = child.data.multipoles.cm - parent.data.multipoles.cm;
+    momShiftFlocr(&shifted, parent_scale, r.x, r.y, r.z);
+    momRescaleFlocr(&shifted, child_scale, parent_scale);
+    momAddFlocr(&child.data.local, &shifted);
+#endif
+  }
+
+  /// @brief L2P: evaluates leaf's local expansion at its particles.
+  void evalLocal(SpatialNode<CentroidData>& leaf) {
+#ifdef HEXADECAPOLE
+    auto& center = leaf.data.multipoles.cm;
+    for (int i = 0; i < leaf.n_particles; i++) {
+      Vector3D<Real> r = leaf.particles()[i].position - center;
+      Vector3D<Real> accel (0.0);
+      Real potential = 0.0;
+      momEvalFlocr(&leaf.data.local, leaf.data.multipoles.radius, r.x, r.y, r.z,
+                   &potential, &accel.x, &accel.y, &accel.z);
+      leaf.applyAcceleration(i, accel);
+      leaf.applyPotential(i, potential);
+    }
+#endif
+  }
+};
+
+#endif //PARATREET_GRAVITYFMMVISITOR_H_
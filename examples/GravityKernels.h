@@ -0,0 +1,300 @@
+#ifndef PARATREET_GRAVITYKERNELS_H_
+#define PARATREET_GRAVITYKERNELS_H_
+
+#include "common.h"
+#include "ParticleSoA.h"
+#include "Simd.h"
+#ifdef HEXADECAPOLE
+#include "moments.h"
+#endif
+#include <cmath>
+
+inline Real COSMO_CONST(const Real C) {return C;}
+/// Calculate softened force and potential terms from cubic spline
+/// density profiles.  Terms are returned in a and b.
+///
+inline
+void SPLINE(Real r2, Real twoh, Real &a, Real &b)
+{
+  auto r = sqrt(r2);
+
+  if (r < twoh) {
+    auto dih = COSMO_CONST(2.0)/twoh;
+    auto u = r*dih;
+    if (u < COSMO_CONST(1.0)) {
+      a = dih*(COSMO_CONST(7.0)/COSMO_CONST(5.0)
+	       - COSMO_CONST(2.0)/COSMO_CONST(3.0)*u*u
+	       + COSMO_CONST(3.0)/COSMO_CONST(10.0)*u*u*u*u
+	       - COSMO_CONST(1.0)/COSMO_CONST(10.0)*u*u*u*u*u);
+      b = dih*dih*dih*(COSMO_CONST(4.0)/COSMO_CONST(3.0)
+		       - COSMO_CONST(6.0)/COSMO_CONST(5.0)*u*u
+		       + COSMO_CONST(1.0)/COSMO_CONST(2.0)*u*u*u);
+    }
+    else {
+      auto dir = COSMO_CONST(1.0)/r;
+      a = COSMO_CONST(-1.0)/COSMO_CONST(15.0)*dir
+	+ dih*(COSMO_CONST(8.0)/COSMO_CONST(5.0)
+	       - COSMO_CONST(4.0)/COSMO_CONST(3.0)*u*u + u*u*u
+	       - COSMO_CONST(3.0)/COSMO_CONST(10.0)*u*u*u*u
+	       + COSMO_CONST(1.0)/COSMO_CONST(30.0)*u*u*u*u*u);
+      b = COSMO_CONST(-1.0)/COSMO_CONST(15.0)*dir*dir*dir
+	+ dih*dih*dih*(COSMO_CONST(8.0)/COSMO_CONST(3.0) - COSMO_CONST(3.0)*u
+		       + COSMO_CONST(6.0)/COSMO_CONST(5.0)*u*u
+		       - COSMO_CONST(1.0)/COSMO_CONST(6.0)*u*u*u);
+    }
+  }
+  else {
+    a = COSMO_CONST(1.0)/r;
+    b = a*a*a;
+  }
+}
+
+/// Softened force terms for quadrupole evaluation; unsoftened
+/// these are 1/r, 1/r^3, 3/r^5 and 15/r^7.
+inline
+void SPLINEQ(Real invr, Real r2, Real twoh, Real& a, Real& b, Real& c, Real& d)
+{
+  Real u,dih,dir=(invr);
+  if ((r2) < (twoh)*(twoh)) {
+    dih = 2.0/(twoh);
+    u = dih/dir;
+    if (u < 1.0) {
+      a = dih*(7.0/5.0
+	       - 2.0/3.0*u*u
+	       + 3.0/10.0*u*u*u*u
+	       - 1.0/10.0*u*u*u*u*u);
+      b = dih*dih*dih*(4.0/3.0
+		       - 6.0/5.0*u*u
+		       + 1.0/2.0*u*u*u);
+      c = dih*dih*dih*dih*dih*(12.0/5.0
+			       - 3.0/2.0*u);
+      d = 3.0/2.0*dih*dih*dih*dih*dih*dih*dir;
+    }
+    else {
+      a = -1.0/15.0*dir
+	+ dih*(8.0/5.0
+	       - 4.0/3.0*u*u + u*u*u
+	       - 3.0/10.0*u*u*u*u
+	       + 1.0/30.0*u*u*u*u*u);
+      b = -1.0/15.0*dir*dir*dir
+	+ dih*dih*dih*(8.0/3.0 - 3.0*u
+		       + 6.0/5.0*u*u
+		       - 1.0/6.0*u*u*u);
+      c = -1.0/5.0*dir*dir*dir*dir*dir
+	+ 3.0*dih*dih*dih*dih*dir
+	+ dih*dih*dih*dih*dih*(-12.0/5.0
+			       + 1.0/2.0*u);
+      d = -dir*dir*dir*dir*dir*dir*dir
+	+ 3.0*dih*dih*dih*dih*dir*dir*dir
+	- 1.0/2.0*dih*dih*dih*dih*dih*dih*dir;
+    }
+  }
+  else {
+    a = dir;
+    b = a*a*a;
+    c = 3.0*b*a*a;
+    d = 5.0*c*a*a;
+  }
+}
+
+namespace gravity {
+
+/// Force term b of SPLINE evaluated on every lane without branches.
+/// Lanes with r2 == 0 (self interaction, padding) return 0.
+template <typename V>
+inline V splineForce(V r2, V twoh) {
+  V r = sqrt(r2);
+  V dih = V(2.0) / twoh;
+  V u = r * dih;
+  V dir = V(1.0) / r;
+  V u2 = u * u;
+  V u3 = u2 * u;
+  V dih3 = dih * dih * dih;
+  V inner = dih3 * (V(4.0/3.0) - V(6.0/5.0) * u2 + V(1.0/2.0) * u3);
+  V outer = V(-1.0/15.0) * dir * dir * dir
+    + dih3 * (V(8.0/3.0) - V(3.0) * u + V(6.0/5.0) * u2 - V(1.0/6.0) * u3);
+  V b = select(u < V(1.0), inner, outer);
+  b = select(r < twoh, b, dir * dir * dir);
+  return select(r2 != V(0.0), b, V(0.0));
+}
+
+/// In a scalar build the branchy version is cheaper than evaluating
+/// every region.
+template <>
+inline simd::ScalarVec splineForce(simd::ScalarVec r2, simd::ScalarVec twoh) {
+  if (r2.v == 0) return Real(0);
+  Real a, b;
+  SPLINE(r2.v, twoh.v, a, b);
+  return b;
+}
+
+/// Bucket-bucket (P2P) softened gravity: adds to each target the force of
+/// every source, with source positions shifted by offset. Sources are
+/// processed V::width at a time, the remainder with a masked load.
+template <typename V = simd::RealVec>
+inline void p2p(const ParticleSoA::View& source, int n_source, Vector3D<Real> offset,
+                ParticleSoA::View target, int n_target) {
+  for (int i = 0; i < n_target; i++) {
+    V tx(target.x[i] - offset.x), ty(target.y[i] - offset.y), tz(target.z[i] - offset.z);
+    V tsoft(target.soft[i]);
+    V ax(Real(0)), ay(Real(0)), az(Real(0));
+    for (int j = 0; j < n_source; j += V::width) {
+      int n = n_source - j;
+      V sx = simd::loadN<V>(source.x + j, n);
+      V sy = simd::loadN<V>(source.y + j, n);
+      V sz = simd::loadN<V>(source.z + j, n);
+      V smass = simd::loadN<V>(source.mass + j, n);
+      V ssoft = simd::loadN<V>(source.soft + j, n);
+      V dx = sx - tx, dy = sy - ty, dz = sz - tz;
+      V r2 = dx * dx + dy * dy + dz * dz;
+      V f = splineForce(r2, ssoft + tsoft) * smass;
+      if (n < V::width) f = select(V::prefixMask(n), f, V(Real(0)));
+      ax += dx * f;
+      ay += dy * f;
+      az += dz * f;
+    }
+    target.ax[i] += hsum(ax);
+    target.ay[i] += hsum(ay);
+    target.az[i] += hsum(az);
+  }
+}
+
+/// SPLINEQ evaluated on every lane without branches.
+template <typename V>
+inline void splineQ(V dir, V r2, V twoh, V& a, V& b, V& c, V& d) {
+  V dih = V(2.0) / twoh;
+  V u = dih / dir;
+  V u2 = u * u, u3 = u2 * u, u4 = u3 * u, u5 = u4 * u;
+  V dih3 = dih * dih * dih, dih4 = dih3 * dih, dih5 = dih4 * dih, dih6 = dih5 * dih;
+  V dir3 = dir * dir * dir, dir5 = dir3 * dir * dir, dir7 = dir5 * dir * dir;
+  auto inner = u < V(1.0);
+  auto softened = r2 < twoh * twoh;
+  V a_in = dih * (V(7.0/5.0) - V(2.0/3.0) * u2 + V(3.0/10.0) * u4 - V(1.0/10.0) * u5);
+  V a_out = V(-1.0/15.0) * dir
+    + dih * (V(8.0/5.0) - V(4.0/3.0) * u2 + u3 - V(3.0/10.0) * u4 + V(1.0/30.0) * u5);
+  a = select(softened, select(inner, a_in, a_out), dir);
+  V b_in = dih3 * (V(4.0/3.0) - V(6.0/5.0) * u2 + V(1.0/2.0) * u3);
+  V b_out = V(-1.0/15.0) * dir3 + dih3 * (V(8.0/3.0) - V(3.0) * u + V(6.0/5.0) * u2 - V(1.0/6.0) * u3);
+  b = select(softened, select(inner, b_in, b_out), dir3);
+  V c_in = dih5 * (V(12.0/5.0) - V(3.0/2.0) * u);
+  V c_out = V(-1.0/5.0) * dir5 + V(3.0) * dih4 * dir + dih5 * (V(-12.0/5.0) + V(1.0/2.0) * u);
+  c = select(softened, select(inner, c_in, c_out), V(3.0) * dir5);
+  V d_in = V(3.0/2.0) * dih6 * dir;
+  V d_out = -dir7 + V(3.0) * dih4 * dir3 - V(1.0/2.0) * dih6 * dir;
+  d = select(softened, select(inner, d_in, d_out), V(15.0) * dir7);
+}
+
+template <>
+inline void splineQ(simd::ScalarVec dir, simd::ScalarVec r2, simd::ScalarVec twoh,
+                    simd::ScalarVec& a, simd::ScalarVec& b, simd::ScalarVec& c, simd::ScalarVec& d) {
+  SPLINEQ(dir.v, r2.v, twoh.v, a.v, b.v, c.v, d.v);
+}
+
+#ifdef HEXADECAPOLE
+/// momEvalFmomrcm from moments.C over V::width targets at once, without
+/// the magai output.
+template <typename V>
+inline void evalFmomrcm(const FMOMR& m, V u, V dir, V x, V y, V z,
+                        V& pot, V& ax, V& ay, V& az) {
+  const V onethird(1.0/3.0);
+  V xx, xy, xz, yy, yz, zz;
+  V xxx, xxy, xxz, xyy, yyy, yyz, xyz;
+  V tx, ty, tz, g0, g2, g3, g4;
+
+  u = u * dir;
+  g0 = dir;
+  g2 = V(3.0) * dir * u * u;
+  g3 = V(5.0) * g2 * u;
+  g4 = V(7.0) * g3 * u;
+  x = x * dir;
+  y = y * dir;
+  z = z * dir;
+  xx = V(0.5) * x * x;
+  xy = x * y;
+  xz = x * z;
+  yy = V(0.5) * y * y;
+  yz = y * z;
+  zz = V(0.5) * z * z;
+  xxx = x * (onethird * xx - zz);
+  xxz = z * (xx - onethird * zz);
+  yyy = y * (onethird * yy - zz);
+  yyz = z * (yy - onethird * zz);
+  xx = xx - zz;
+  yy = yy - zz;
+  xxy = y * xx;
+  xyy = x * yy;
+  xyz = xy * z;
+  tx = g4 * (V(m.xxxx)*xxx + V(m.xyyy)*yyy + V(m.xxxy)*xxy + V(m.xxxz)*xxz + V(m.xxyy)*xyy + V(m.xxyz)*xyz + V(m.xyyz)*yyz);
+  ty = g4 * (V(m.xyyy)*xyy + V(m.xxxy)*xxx + V(m.yyyy)*yyy + V(m.yyyz)*yyz + V(m.xxyy)*xxy + V(m.xxyz)*xxz + V(m.xyyz)*xyz);
+  tz = g4 * (V(-m.xxxx)*xxz - V(m.xyyy + m.xxxy)*xyz - V(m.yyyy)*yyz + V(m.xxxz)*xxx + V(m.yyyz)*yyy
+             - V(m.xxyy)*(xxz + yyz) + V(m.xxyz)*xxy + V(m.xyyz)*xyy);
+  g4 = V(0.25) * (tx*x + ty*y + tz*z);
+  xxx = g3 * (V(m.xxx)*xx + V(m.xyy)*yy + V(m.xxy)*xy + V(m.xxz)*xz + V(m.xyz)*yz);
+  xxy = g3 * (V(m.xyy)*xy + V(m.xxy)*xx + V(m.yyy)*yy + V(m.yyz)*yz + V(m.xyz)*xz);
+  xxz = g3 * (V(-(m.xxx + m.xyy))*xz - V(m.xxy + m.yyy)*yz + V(m.xxz)*xx + V(m.yyz)*yy + V(m.xyz)*xy);
+  g3 = onethird * (xxx*x + xxy*y + xxz*z);
+  xx = g2 * (V(m.xx)*x + V(m.xy)*y + V(m.xz)*z);
+  xy = g2 * (V(m.yy)*y + V(m.xy)*x + V(m.yz)*z);
+  xz = g2 * (V(-(m.xx + m.yy))*z + V(m.xz)*x + V(m.yz)*y);
+  g2 = V(0.5) * (xx*x + xy*y + xz*z);
+  g0 = g0 * V(m.m);
+  pot = pot - (g0 + g2 + g3 + g4);
+  g0 = g0 + V(5.0)*g2 + V(7.0)*g3 + V(9.0)*g4;
+  ax = ax + dir * (xx + xxx + tx - x*g0);
+  ay = ay + dir * (xy + xxy + ty - y*g0);
+  az = az + dir * (xz + xxz + tz - z*g0);
+}
+#endif
+
+/// Cell-bucket (M2P) evaluation of one expansion against the n targets
+/// (at most V::width) starting at i. Moments is MultipoleMoments, kept
+/// generic so this header does not need Charm++.
+template <typename V, typename Moments>
+inline void m2pBlock(const Moments& m, V cx, V cy, V cz, ParticleSoA::View target, int i, int n) {
+  using simd::loadN;
+  using simd::storeN;
+  V x = loadN<V>(target.x + i, n) - cx;
+  V y = loadN<V>(target.y + i, n) - cy;
+  V z = loadN<V>(target.z + i, n) - cz;
+  V rsq = x * x + y * y + z * z;
+  V dir = V(1.0) / sqrt(rsq);
+  V pot(Real(0)), ax(Real(0)), ay(Real(0)), az(Real(0));
+#ifdef HEXADECAPOLE
+  evalFmomrcm(m.mom, V(m.getRadius()), dir, x, y, z, pot, ax, ay, az);
+#else
+  V a, b, c, d;
+  splineQ(dir, rsq, V(m.soft) + loadN<V>(target.soft + i, n), a, b, c, d);
+  V qx = V(m.xx) * x + V(m.xy) * y + V(m.xz) * z;
+  V qy = V(m.xy) * x + V(m.yy) * y + V(m.yz) * z;
+  V qz = V(m.xz) * x + V(m.yz) * y + V(m.zz) * z;
+  V qir = V(0.5) * (qx * x + qy * y + qz * z);
+  V tr(Real(0.5 * (m.xx + m.yy + m.zz)));
+  V mass(m.totalMass);
+  V qir3 = b * mass + d * qir - c * tr;
+  pot = b * tr - mass * a - c * qir;
+  ax = c * qx - qir3 * x;
+  ay = c * qy - qir3 * y;
+  az = c * qz - qir3 * z;
+#endif
+  // Padding lanes may hold inf/nan, they are never stored
+  storeN(loadN<V>(target.ax + i, n) + ax, target.ax + i, n);
+  storeN(loadN<V>(target.ay + i, n) + ay, target.ay + i, n);
+  storeN(loadN<V>(target.az + i, n) + az, target.az + i, n);
+  storeN(loadN<V>(target.pot + i, n) + pot, target.pot + i, n);
+}
+
+/// Multipole expansion of one cell, with its center shifted by offset,
+/// evaluated on a whole bucket V::width targets at a time, the remainder
+/// with masked loads and stores.
+template <typename V = simd::RealVec, typename Moments>
+inline void m2p(const Moments& m, Vector3D<Real> offset, ParticleSoA::View target, int n_target) {
+  Vector3D<Real> center = m.cm + offset;
+  V cx(center.x), cy(center.y), cz(center.z);
+  for (int i = 0; i < n_target; i += V::width) {
+    m2pBlock<V>(m, cx, cy, cz, target, i, n_target - i);
+  }
+}
+
+} // namespace gravity
+
+#endif // PARATREET_GRAVITYKERNELS_H_
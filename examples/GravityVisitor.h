@@ -4,6 +4,7 @@
 #include "paratreet.decl.h"
 #include "common.h"
 #include "Space.h"
+#include "GravityKernels.h"
 #include <cmath>
 
 class GravityVisitor {
@@ -11,6 +12,9 @@ public:
   static constexpr const bool CallSelfLeaf = true;
   static constexpr const bool ForceEvenDepth = true;
   static constexpr const bool TargetMustBeLeaf = true;
+  static constexpr const bool UseLocalExpansion = false;
+  // Remote leaves are only read by the particle-particle kernels
+  static constexpr const unsigned ExportFields = paratreet::eExportPosition | paratreet::eExportMass | paratreet::eExportSoft;
   static constexpr const Real opening_geometry_factor_squared = 4.0 / 3.0;
   GravityVisitor() : offset(0, 0, 0) {}
   GravityVisitor(Vector3D<Real> offseti, Real theta) :
@@ -25,100 +29,15 @@ public:
     p | monopole_gravity_factor;
   }
 
-private:
+protected:
   Vector3D<Real> offset;
   Real gravity_factor;
   Real monopole_gravity_factor;
 
-private:
+protected:
   // note gconst = 1
   static constexpr int  nMinParticleNode = 6;
 
-  inline void SPLINEQ(Real invr, Real r2, Real twoh, Real& a, Real& b, Real& c, Real& d)
-{
-  Real u,dih,dir=(invr);
-  if ((r2) < (twoh)*(twoh)) {
-    dih = 2.0/(twoh);
-    u = dih/dir;
-    if (u < 1.0) {
-      a = dih*(7.0)/5.0 
-	       - 2.0/3.0*u*u 
-	       + 3.0/10.0*u*u*u*u
-	       - 1.0/10.0*u*u*u*u*u;
-      b = dih*dih*dih*(4.0)/3.0
-		       - 6.0/5.0*u*u 
-		       + 1.0/2.0*u*u*u;
-      c = dih*dih*dih*dih*dih*(12.0)/5.0
-			       - 3.0/2.0*u;
-      d = 3.0/2.0*dih*dih*dih*dih*dih*dih*dir;
-    }
-    else {
-      a = -1.0/15.0*dir
-	+ dih*(8.0/5.0)
-	       - 4.0/3.0*u*u + u*u*u
-	       - 3.0/10.0*u*u*u*u
-	       + 1.0/30.0*u*u*u*u*u;
-      b = -1.0/15.0*dir*dir*dir
-	+ dih*dih*dih*(8.0)/3.0 - 3.0*u
-		       + 6.0/5.0*u*u
-		       - 1.0/6.0*u*u*u;
-      c = -1.0/5.0*dir*dir*dir*dir*dir
-	+ 3.0*dih*dih*dih*dih*dir
-	+ dih*dih*dih*dih*dih*(-12.0)/5.0
-			       + 1.0/2.0*u;
-      d = -dir*dir*dir*dir*dir*dir*dir
-	+ 3.0*dih*dih*dih*dih*dir*dir*dir
-	- 1.0/2.0*dih*dih*dih*dih*dih*dih*dir;
-    }
-  }
-  else {
-    a = dir;
-    b = a*a*a;
-    c = 3.0*b*a*a;
-    d = 5.0*c*a*a;
-  }
-}
-
-inline Real COSMO_CONST(const Real C) {return C;}
-/// Calculate softened force and potential terms from cubic spline
-/// density profiles.  Terms are returned in a and b.
-/// 
-inline
-void SPLINE(Real r2, Real twoh, Real &a, Real &b)
-{
-  auto r = sqrt(r2);
-
-  if (r < twoh) {
-    auto dih = COSMO_CONST(2.0)/twoh;
-    auto u = r*dih;
-    if (u < COSMO_CONST(1.0)) {
-      a = dih*(COSMO_CONST(7.0)/COSMO_CONST(5.0) 
-	       - COSMO_CONST(2.0)/COSMO_CONST(3.0)*u*u 
-	       + COSMO_CONST(3.0)/COSMO_CONST(10.0)*u*u*u*u
-	       - COSMO_CONST(1.0)/COSMO_CONST(10.0)*u*u*u*u*u);
-      b = dih*dih*dih*(COSMO_CONST(4.0)/COSMO_CONST(3.0) 
-		       - COSMO_CONST(6.0)/COSMO_CONST(5.0)*u*u 
-		       + COSMO_CONST(1.0)/COSMO_CONST(2.0)*u*u*u);
-    }
-    else {
-      auto dir = COSMO_CONST(1.0)/r;
-      a = COSMO_CONST(-1.0)/COSMO_CONST(15.0)*dir 
-	+ dih*(COSMO_CONST(8.0)/COSMO_CONST(5.0) 
-	       - COSMO_CONST(4.0)/COSMO_CONST(3.0)*u*u + u*u*u
-	       - COSMO_CONST(3.0)/COSMO_CONST(10.0)*u*u*u*u 
-	       + COSMO_CONST(1.0)/COSMO_CONST(30.0)*u*u*u*u*u);
-      b = COSMO_CONST(-1.0)/COSMO_CONST(15.0)*dir*dir*dir 
-	+ dih*dih*dih*(COSMO_CONST(8.0)/COSMO_CONST(3.0) - COSMO_CONST(3.0)*u 
-		       + COSMO_CONST(6.0)/COSMO_CONST(5.0)*u*u 
-		       - COSMO_CONST(1.0)/COSMO_CONST(6.0)*u*u*u);
-    }
-  }
-  else {
-    a = COSMO_CONST(1.0)/r;
-    b = a*a*a;
-  }
-}
-
   inline bool openSoftening(const CentroidData& source, const CentroidData& target)
   {
     Sphere<Real> sourceSphere(source.multipoles.cm + offset, 2.0 * source.multipoles.soft);
@@ -127,21 +46,102 @@ void SPLINE(Real r2, Real twoh, Real &a, Real &b)
     return Space::intersect(target.box, sourceSphere);
   }
 
-  void addGravity(const SpatialNode<CentroidData>& source, SpatialNode<CentroidData>& target) {
+  void addGravity(const CentroidData& source, SpatialNode<CentroidData>& target) {
     for (int i = 0; i < target.n_particles; i++) {
-      Vector3D<Real> diff = source.data.multipoles.cm + offset - target.particles()[i].position;
+      Vector3D<Real> diff = source.multipoles.cm + offset - target.particles()[i].position;
       Real rsq = diff.lengthSquared();
       if (rsq != 0) {
-        Vector3D<Real> accel = diff * (source.data.multipoles.totalMass / (rsq * sqrt(rsq)));
+        Vector3D<Real> accel = diff * (source.multipoles.totalMass / (rsq * sqrt(rsq)));
         target.applyAcceleration(i, accel);
       }
     }
   }
 
+  /// Runs kernel on target's structure-of-arrays view, or on a gathered
+  /// copy whose results are added back if target has no store of its own.
+  template <typename Kernel>
+  void withTargetView(SpatialNode<CentroidData>& target, Kernel kernel) {
+    if (target.hasHotParticles()) {
+      kernel(target.hot());
+      return;
+    }
+    static thread_local ParticleSoA target_scratch;
+    target_scratch.assign(target.particles(), target.n_particles);
+    kernel(target_scratch.view(0));
+    for (int i = 0; i < target.n_particles; i++) {
+      target.applyAcceleration(i, Vector3D<Real>(target_scratch.ax[i], target_scratch.ay[i], target_scratch.az[i]));
+      target.applyPotential(i, target_scratch.pot[i]);
+    }
+  }
+
+  void p2p(const ParticleSoA::View& source, int n_source, SpatialNode<CentroidData>& target) {
+    withTargetView(target, [&](ParticleSoA::View t) {
+      gravity::p2p(source, n_source, offset, t, target.n_particles);
+    });
+  }
+
+  void cellGravity(const CentroidData& source, SpatialNode<CentroidData>& target) {
+    if (source.count == 0) return;
+#ifdef BARNESHUT
+    addGravity(source, target);
+#else
+    if (openSoftening(source, target.data)) {
+      addGravity(source, target);
+      return;
+    }
+    auto& m = source.multipoles;
+    if (target.hasHotParticles() || simd::RealVec::width > 1) {
+      withTargetView(target, [&](ParticleSoA::View t) {
+        gravity::m2p(m, offset, t, target.n_particles);
+      });
+      return;
+    }
+    for (int i = 0; i < target.n_particles; i++) {
+      auto& part = target.particles()[i];
+      auto r = part.position - m.cm - offset;
+      auto rsq = r.lengthSquared();
+      Real dir = 1.0 / sqrt(rsq);
+#ifdef HEXADECAPOLE
+      Vector3D<Real> accel (0.0);
+      Real potential = 0.0;
+      Real magai;
+      momEvalFmomrcm(&m.mom, m.getRadius(), dir, r.x, r.y, r.z,
+		  &potential, &accel.x, &accel.y, &accel.z, &magai);
+      target.applyAcceleration(i, accel);
+      target.applyPotential(i, potential);
+#else
+      Real twoh = m.soft + part.soft;
+      Real a, b, c, d; 
+      SPLINEQ(dir, rsq, twoh, a, b, c, d);
+      Vector3D<Real> qirv;
+      qirv.x = m.xx*r.x + m.xy*r.y + m.xz*r.z;
+      qirv.y = m.xy*r.x + m.yy*r.y + m.yz*r.z;
+      qirv.z = m.xz*r.x + m.yz*r.y + m.zz*r.z;
+      Real qir = 0.5 * dot(qirv, r);
+      Real tr = 0.5 * (m.xx + m.yy + m.zz);
+      Real qir3 = b*m.totalMass + d*qir - c*tr;
+      target.applyPotential(i, -m.totalMass * a - c*qir + b*tr);
+      auto accel = (-qir3 * r) + (c * qirv);
+      target.applyAcceleration(i, accel);
+#endif
+    }
+#endif
+  }
+
 public:
   /// @brief We've hit a leaf: N^2 interactions between all particles
   /// in the target and node.
   void leaf(const SpatialNode<CentroidData>& source, SpatialNode<CentroidData>& target) {
+    if (source.hasHotParticles() && (target.hasHotParticles() || simd::RealVec::width > 1)) {
+      p2p(source.hot(), source.n_particles, target);
+      return;
+    }
+    if (simd::RealVec::width > 1) {
+      static thread_local ParticleSoA source_scratch;
+      source_scratch.assign(source.particles(), source.n_particles);
+      p2p(source_scratch.view(0), source.n_particles, target);
+      return;
+    }
     for (int i = 0; i < target.n_particles; i++) {
       Vector3D<Real> accel(0.0);
       for (int j = 0; j < source.n_particles; j++) {
@@ -182,45 +182,20 @@ public:
   }
 
   void node(const SpatialNode<CentroidData>& source, SpatialNode<CentroidData>& target) {
-    if (source.data.count == 0) return;
-#ifdef BARNESHUT
-    addGravity(source, target);
-#else
-    if (openSoftening(source.data, target.data)) {
-      addGravity(source, target);
-      return;
-    }
-    auto& m = source.data.multipoles;
-    for (int i = 0; i < target.n_particles; i++) {
-      auto& part = target.particles()[i];
-      auto r = part.position - m.cm - offset;
-      auto rsq = r.lengthSquared();
-      Real dir = 1.0 / sqrt(rsq);
-#ifdef HEXADECAPOLE
-      Vector3D<Real> accel (0.0);
-      Real potential = 0.0;
-      Real magai;
-      momEvalFmomrcm(&m.mom, m.getRadius(), dir, r.x, r.y, r.z,
-		  &potential, &accel.x, &accel.y, &accel.z, &magai);
-      target.applyAcceleration(i, accel);
-      target.applyPotential(i, potential);
-#else
-      Real twoh = m.soft + part.soft;
-      Real a, b, c, d; 
-      SPLINEQ(dir, rsq, twoh, a, b, c, d);
-      Vector3D<Real> qirv;
-      qirv.x = m.xx*r.x + m.xy*r.y + m.xz*r.z;
-      qirv.y = m.xy*r.x + m.yy*r.y + m.yz*r.z;
-      qirv.z = m.xz*r.x + m.yz*r.y + m.zz*r.z;
-      Real qir = 0.5 * dot(qirv, r);
-      Real tr = 0.5 * (m.xx + m.yy + m.zz);
-      Real qir3 = b*m.totalMass + d*qir - c*tr;
-      target.applyPotential(i, -m.totalMass * a - c*qir + b*tr);
-      auto accel = (-qir3 * r) + (c * qirv);
-      target.applyAcceleration(i, accel);
-#endif
-    }
-#endif
+    cellGravity(source.data, target);
+  }
+
+  /// @brief Evaluates an interaction list: every accepted cell, then
+  /// every source leaf gathered into one contiguous block for P2P.
+  void nodeBatch(const std::vector<const CentroidData*>& cells, SpatialNode<CentroidData>& target) {
+    for (auto cell : cells) cellGravity(*cell, target);
+  }
+
+  void leafBatch(const std::vector<const SpatialNode<CentroidData>*>& sources, SpatialNode<CentroidData>& target) {
+    static thread_local ParticleSoA source_scratch;
+    source_scratch.clear();
+    for (auto source : sources) source_scratch.append(source->particles(), source->n_particles);
+    p2p(source_scratch.view(0), source_scratch.size(), target);
   }
 
   bool cell(const SpatialNode<CentroidData>& source, SpatialNode<CentroidData>& target) {
@@ -18,145 +18,6 @@
 #include "moments.h"
 #endif
 
-#if CMK_SSE && defined(HEXADECAPOLE) 
-/*
- ** This is a new fast version of QEVAL which evaluates
- ** the interaction due to the reduced moment 'm'.
- ** This version is nearly two times as fast as a naive
- ** implementation.
- **
- ** OpCount = (*,+) = (103,72) = 175 - 8 = 167
- */
-inline 
-void momEvalMomr(MOMR *m,SSEReal dir0,SSEReal x,SSEReal y,
-		 SSEReal z,SSEReal *fPot,SSEReal *ax,
-		 SSEReal *ay,SSEReal *az)
-{
-	const SSEReal onethird = 1.0/3.0;
-	SSEReal xx,xy,xz,yy,yz,zz;
-	SSEReal xxx,xxy,xxz,xyy,yyy,yyz,xyz;
-	SSEReal tx,ty,tz,dir2,g2,g3,g4;
-	SSEReal dir;
-
-	dir = -dir0;
-	dir2 = dir*dir;
-	g2 = 3.0*dir*dir2*dir2;
-	g3 = -5.0*g2*dir2;
-	g4 = -7.0*g3*dir2;
-	/*
-	 ** Calculate the funky distance terms.
-	 */
-	xx = 0.5*x*x;
-	xy = x*y;
-	xz = x*z;
-	yy = 0.5*y*y;
-	yz = y*z;
-	zz = 0.5*z*z;
-	xxx = x*(onethird*xx - zz);
-	xxz = z*(xx - onethird*zz);
-	yyy = y*(onethird*yy - zz);
-	yyz = z*(yy - onethird*zz);
-	xx -= zz;
-	yy -= zz;
-	xxy = y*xx;
-	xyy = x*yy;
-	xyz = xy*z;
-	/*
-	 ** Now calculate the interaction up to Hexadecapole order.
-	 */
-	tx = g4*(m->xxxx*xxx + m->xyyy*yyy + m->xxxy*xxy + m->xxxz*xxz + m->xxyy*xyy + m->xxyz*xyz + m->xyyz*yyz);
-	ty = g4*(m->xyyy*xyy + m->xxxy*xxx + m->yyyy*yyy + m->yyyz*yyz + m->xxyy*xxy + m->xxyz*xxz + m->xyyz*xyz);
-	tz = g4*(-m->xxxx*xxz - (m->xyyy + m->xxxy)*xyz - m->yyyy*yyz + m->xxxz*xxx + m->yyyz*yyy - m->xxyy*(xxz + yyz) + m->xxyz*xxy + m->xyyz*xyy);
-	g4 = 0.25*(tx*x + ty*y + tz*z);
-	xxx = g3*(m->xxx*xx + m->xyy*yy + m->xxy*xy + m->xxz*xz + m->xyz*yz);
-	xxy = g3*(m->xyy*xy + m->xxy*xx + m->yyy*yy + m->yyz*yz + m->xyz*xz);
-	xxz = g3*(-(m->xxx + m->xyy)*xz - (m->xxy + m->yyy)*yz + m->xxz*xx + m->yyz*yy + m->xyz*xy);
-	g3 = onethird*(xxx*x + xxy*y + xxz*z);
-	xx = g2*(m->xx*x + m->xy*y + m->xz*z);
-	xy = g2*(m->yy*y + m->xy*x + m->yz*z);
-	xz = g2*(-(m->xx + m->yy)*z + m->xz*x + m->yz*y);
-	g2 = 0.5*(xx*x + xy*y + xz*z);
-	dir *= m->m;
-	dir2 *= -(dir + 5.0*g2 + 7.0*g3 + 9.0*g4);
-	*fPot += dir + g2 + g3 + g4;
-	*ax += xx + xxx + tx + x*dir2;
-	*ay += xy + xxy + ty + y*dir2;
-	*az += xz + xxz + tz + z*dir2;
-	}
-/*
- ** This is a new fast version of QEVAL which evaluates
- ** the interaction due to the reduced moment 'm'.
- ** This version is nearly two times as fast as a naive
- ** implementation.
- **
- ** March 23, 2007: This function now uses unit vectors
- ** which reduces the required precision in the exponent
- ** since the highest power of r is now 5 (g4 ~ r^(-5)).
- **
- ** OpCount = (*,+) = (106,72) = 178 - 8 = 170
- **
- */
-inline
-void momEvalFmomrcm(FMOMR *m,SSEReal u,SSEReal dir,SSEReal x,
-		    SSEReal y,SSEReal z,
-		    SSEReal *fPot,SSEReal *ax,SSEReal *ay,
-		    SSEReal *az,SSEReal *magai) {
-    const SSEReal onethird = 1.0f/3.0f;
-    SSEReal xx,xy,xz,yy,yz,zz;
-    SSEReal xxx,xxy,xxz,xyy,yyy,yyz,xyz;
-    SSEReal tx,ty,tz,g0,g2,g3,g4;
-
-    u *= dir;
-    g0 = dir;
-    g2 = 3*dir*u*u;
-    g3 = 5*g2*u;
-    g4 = 7*g3*u;
-    /*
-     ** Calculate the trace-free distance terms.
-     */
-    x *= dir;
-    y *= dir;
-    z *= dir;
-    xx = 0.5*x*x;
-    xy = x*y;
-    xz = x*z;
-    yy = 0.5*y*y;
-    yz = y*z;
-    zz = 0.5*z*z;
-    xxx = x*(onethird*xx - zz);
-    xxz = z*(xx - onethird*zz);
-    yyy = y*(onethird*yy - zz);
-    yyz = z*(yy - onethird*zz);
-    xx -= zz;
-    yy -= zz;
-    xxy = y*xx;
-    xyy = x*yy;
-    xyz = xy*z;
-    /*
-     ** Now calculate the interaction up to Hexadecapole order.
-     */
-    tx = g4*(m->xxxx*xxx + m->xyyy*yyy + m->xxxy*xxy + m->xxxz*xxz + m->xxyy*xyy + m->xxyz*xyz + m->xyyz*yyz);
-    ty = g4*(m->xyyy*xyy + m->xxxy*xxx + m->yyyy*yyy + m->yyyz*yyz + m->xxyy*xxy + m->xxyz*xxz + m->xyyz*xyz);
-    tz = g4*(-m->xxxx*xxz - (m->xyyy + m->xxxy)*xyz - m->yyyy*yyz + m->xxxz*xxx + m->yyyz*yyy - m->xxyy*(xxz + yyz) + m->xxyz*xxy + m->xyyz*xyy);
-    g4 = 0.25*(tx*x + ty*y + tz*z);
-    xxx = g3*(m->xxx*xx + m->xyy*yy + m->xxy*xy + m->xxz*xz + m->xyz*yz);
-    xxy = g3*(m->xyy*xy + m->xxy*xx + m->yyy*yy + m->yyz*yz + m->xyz*xz);
-    xxz = g3*(-(m->xxx + m->xyy)*xz - (m->xxy + m->yyy)*yz + m->xxz*xx + m->yyz*yy + m->xyz*xy);
-    g3 = onethird*(xxx*x + xxy*y + xxz*z);
-    xx = g2*(m->xx*x + m->xy*y + m->xz*z);
-    xy = g2*(m->yy*y + m->xy*x + m->yz*z);
-    xz = g2*(-(m->xx + m->yy)*z + m->xz*x + m->yz*y);
-    g2 = 0.5*(xx*x + xy*y + xz*z);
-    g0 *= m->m;
-    *fPot += -(g0 + g2 + g3 + g4);
-    g0 += 5*g2 + 7*g3 + 9*g4;
-    *ax += dir*(xx + xxx + tx - x*g0);
-    *ay += dir*(xy + xxy + ty - y*g0);
-    *az += dir*(xz + xxz + tz - z*g0);
-    *magai = g0*dir;
-    }
-#endif
-
 /// A representation of a multipole expansion.
 class MultipoleMoments {
 public:
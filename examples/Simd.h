@@ -0,0 +1,198 @@
+#ifndef PARATREET_SIMD_H_
+#define PARATREET_SIMD_H_
+
+#include "common.h"
+#include <cmath>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Minimal vector types for the gravity kernels. RealVec is the widest
+// vector of Real enabled at build time (AVX-512, AVX2, or a single lane),
+// ScalarVec always has one lane and is used for remainders. Both expose the
+// same operations so kernels can be written once as templates.
+namespace simd {
+
+struct ScalarVec {
+  static constexpr int width = 1;
+  using Mask = bool;
+  Real v;
+
+  ScalarVec() = default;
+  ScalarVec(Real x) : v(x) {}
+
+  static ScalarVec load(const Real* p) {return ScalarVec(*p);}
+  static ScalarVec loadPartial(const Real* p, int n) {return ScalarVec(n > 0 ? *p : Real(0));}
+  static Mask prefixMask(int n) {return n > 0;}
+  void store(Real* p) const {*p = v;}
+  void storePartial(Real* p, int n) const {if (n > 0) *p = v;}
+};
+
+inline ScalarVec operator+(ScalarVec a, ScalarVec b) {return a.v + b.v;}
+inline ScalarVec operator-(ScalarVec a, ScalarVec b) {return a.v - b.v;}
+inline ScalarVec operator*(ScalarVec a, ScalarVec b) {return a.v * b.v;}
+inline ScalarVec operator/(ScalarVec a, ScalarVec b) {return a.v / b.v;}
+inline ScalarVec operator-(ScalarVec a) {return -a.v;}
+inline bool operator<(ScalarVec a, ScalarVec b) {return a.v < b.v;}
+inline bool operator!=(ScalarVec a, ScalarVec b) {return a.v != b.v;}
+inline ScalarVec sqrt(ScalarVec a) {return std::sqrt(a.v);}
+inline ScalarVec select(bool m, ScalarVec a, ScalarVec b) {return m ? a : b;}
+inline Real hsum(ScalarVec a) {return a.v;}
+
+#if defined(__AVX512F__) && !defined(USE_DOUBLE_FP)
+
+struct RealVec {
+  static constexpr int width = 16;
+  using Mask = __mmask16;
+  __m512 v;
+
+  RealVec() = default;
+  RealVec(__m512 x) : v(x) {}
+  RealVec(Real x) : v(_mm512_set1_ps(x)) {}
+
+  static RealVec load(const Real* p) {return _mm512_loadu_ps(p);}
+  static RealVec loadPartial(const Real* p, int n) {return _mm512_maskz_loadu_ps(prefixMask(n), p);}
+  static Mask prefixMask(int n) {return (Mask)((1u << n) - 1);}
+  void store(Real* p) const {_mm512_storeu_ps(p, v);}
+  void storePartial(Real* p, int n) const {_mm512_mask_storeu_ps(p, prefixMask(n), v);}
+};
+
+inline RealVec operator+(RealVec a, RealVec b) {return _mm512_add_ps(a.v, b.v);}
+inline RealVec operator-(RealVec a, RealVec b) {return _mm512_sub_ps(a.v, b.v);}
+inline RealVec operator*(RealVec a, RealVec b) {return _mm512_mul_ps(a.v, b.v);}
+inline RealVec operator/(RealVec a, RealVec b) {return _mm512_div_ps(a.v, b.v);}
+inline RealVec operator-(RealVec a) {return _mm512_sub_ps(_mm512_setzero_ps(), a.v);}
+inline RealVec::Mask operator<(RealVec a, RealVec b) {return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ);}
+inline RealVec::Mask operator!=(RealVec a, RealVec b) {return _mm512_cmp_ps_mask(a.v, b.v, _CMP_NEQ_UQ);}
+inline RealVec sqrt(RealVec a) {return _mm512_sqrt_ps(a.v);}
+inline RealVec select(RealVec::Mask m, RealVec a, RealVec b) {return _mm512_mask_blend_ps(m, b.v, a.v);}
+inline Real hsum(RealVec a) {return _mm512_reduce_add_ps(a.v);}
+
+#elif defined(__AVX512F__)
+
+struct RealVec {
+  static constexpr int width = 8;
+  using Mask = __mmask8;
+  __m512d v;
+
+  RealVec() = default;
+  RealVec(__m512d x) : v(x) {}
+  RealVec(Real x) : v(_mm512_set1_pd(x)) {}
+
+  static RealVec load(const Real* p) {return _mm512_loadu_pd(p);}
+  static RealVec loadPartial(const Real* p, int n) {return _mm512_maskz_loadu_pd(prefixMask(n), p);}
+  static Mask prefixMask(int n) {return (Mask)((1u << n) - 1);}
+  void store(Real* p) const {_mm512_storeu_pd(p, v);}
+  void storePartial(Real* p, int n) const {_mm512_mask_storeu_pd(p, prefixMask(n), v);}
+};
+
+inline RealVec operator+(RealVec a, RealVec b) {return _mm512_add_pd(a.v, b.v);}
+inline RealVec operator-(RealVec a, RealVec b) {return _mm512_sub_pd(a.v, b.v);}
+inline RealVec operator*(RealVec a, RealVec b) {return _mm512_mul_pd(a.v, b.v);}
+inline RealVec operator/(RealVec a, RealVec b) {return _mm512_div_pd(a.v, b.v);}
+inline RealVec operator-(RealVec a) {return _mm512_sub_pd(_mm512_setzero_pd(), a.v);}
+inline RealVec::Mask operator<(RealVec a, RealVec b) {return _mm512_cmp_pd_mask(a.v, b.v, _CMP_LT_OQ);}
+inline RealVec::Mask operator!=(RealVec a, RealVec b) {return _mm512_cmp_pd_mask(a.v, b.v, _CMP_NEQ_UQ);}
+inline RealVec sqrt(RealVec a) {return _mm512_sqrt_pd(a.v);}
+inline RealVec select(RealVec::Mask m, RealVec a, RealVec b) {return _mm512_mask_blend_pd(m, b.v, a.v);}
+inline Real hsum(RealVec a) {return _mm512_reduce_add_pd(a.v);}
+
+#elif defined(__AVX2__) && !defined(USE_DOUBLE_FP)
+
+struct RealVec {
+  static constexpr int width = 8;
+  using Mask = __m256;
+  __m256 v;
+
+  RealVec() = default;
+  RealVec(__m256 x) : v(x) {}
+  RealVec(Real x) : v(_mm256_set1_ps(x)) {}
+
+  static RealVec load(const Real* p) {return _mm256_loadu_ps(p);}
+  static RealVec loadPartial(const Real* p, int n) {
+    return _mm256_maskload_ps(p, _mm256_castps_si256(prefixMask(n)));
+  }
+  static Mask prefixMask(int n) {
+    return _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(n),
+                                                  _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+  }
+  void store(Real* p) const {_mm256_storeu_ps(p, v);}
+  void storePartial(Real* p, int n) const {_mm256_maskstore_ps(p, _mm256_castps_si256(prefixMask(n)), v);}
+};
+
+inline RealVec operator+(RealVec a, RealVec b) {return _mm256_add_ps(a.v, b.v);}
+inline RealVec operator-(RealVec a, RealVec b) {return _mm256_sub_ps(a.v, b.v);}
+inline RealVec operator*(RealVec a, RealVec b) {return _mm256_mul_ps(a.v, b.v);}
+inline RealVec operator/(RealVec a, RealVec b) {return _mm256_div_ps(a.v, b.v);}
+inline RealVec operator-(RealVec a) {return _mm256_sub_ps(_mm256_setzero_ps(), a.v);}
+inline RealVec::Mask operator<(RealVec a, RealVec b) {return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ);}
+inline RealVec::Mask operator!=(RealVec a, RealVec b) {return _mm256_cmp_ps(a.v, b.v, _CMP_NEQ_UQ);}
+inline RealVec sqrt(RealVec a) {return _mm256_sqrt_ps(a.v);}
+inline RealVec select(RealVec::Mask m, RealVec a, RealVec b) {return _mm256_blendv_ps(b.v, a.v, m);}
+inline Real hsum(RealVec a) {
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(a.v), _mm256_extractf128_ps(a.v, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_movehdup_ps(s));
+  return _mm_cvtss_f32(s);
+}
+
+#elif defined(__AVX2__)
+
+struct RealVec {
+  static constexpr int width = 4;
+  using Mask = __m256d;
+  __m256d v;
+
+  RealVec() = default;
+  RealVec(__m256d x) : v(x) {}
+  RealVec(Real x) : v(_mm256_set1_pd(x)) {}
+
+  static RealVec load(const Real* p) {return _mm256_loadu_pd(p);}
+  static RealVec loadPartial(const Real* p, int n) {
+    return _mm256_maskload_pd(p, _mm256_castpd_si256(prefixMask(n)));
+  }
+  static Mask prefixMask(int n) {
+    return _mm256_castsi256_pd(_mm256_cmpgt_epi64(_mm256_set1_epi64x(n),
+                                                  _mm256_setr_epi64x(0, 1, 2, 3)));
+  }
+  void store(Real* p) const {_mm256_storeu_pd(p, v);}
+  void storePartial(Real* p, int n) const {_mm256_maskstore_pd(p, _mm256_castpd_si256(prefixMask(n)), v);}
+};
+
+inline RealVec operator+(RealVec a, RealVec b) {return _mm256_add_pd(a.v, b.v);}
+inline RealVec operator-(RealVec a, RealVec b) {return _mm256_sub_pd(a.v, b.v);}
+inline RealVec operator*(RealVec a, RealVec b) {return _mm256_mul_pd(a.v, b.v);}
+inline RealVec operator/(RealVec a, RealVec b) {return _mm256_div_pd(a.v, b.v);}
+inline RealVec operator-(RealVec a) {return _mm256_sub_pd(_mm256_setzero_pd(), a.v);}
+inline RealVec::Mask operator<(RealVec a, RealVec b) {return _mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ);}
+inline RealVec::Mask operator!=(RealVec a, RealVec b) {return _mm256_cmp_pd(a.v, b.v, _CMP_NEQ_UQ);}
+inline RealVec sqrt(RealVec a) {return _mm256_sqrt_pd(a.v);}
+inline RealVec select(RealVec::Mask m, RealVec a, RealVec b) {return _mm256_blendv_pd(b.v, a.v, m);}
+inline Real hsum(RealVec a) {
+  __m128d s = _mm_add_pd(_mm256_castpd256_pd128(a.v), _mm256_extractf128_pd(a.v, 1));
+  return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+
+#else
+
+using RealVec = ScalarVec;
+
+#endif
+
+/// Loads/stores the first n lanes, all of them if n >= width
+template <typename V> inline V loadN(const Real* p, int n) {
+  return n >= V::width ? V::load(p) : V::loadPartial(p, n);
+}
+template <typename V> inline void storeN(V a, Real* p, int n) {
+  if (n >= V::width) a.store(p);
+  else a.storePartial(p, n);
+}
+
+template <typename V> inline V& operator+=(V& a, V b) {return a = a + b;}
+template <typename V> inline V& operator-=(V& a, V b) {return a = a - b;}
+template <typename V> inline V& operator*=(V& a, V b) {return a = a * b;}
+
+} // namespace simd
+
+#endif // PARATREET_SIMD_H_
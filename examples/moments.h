@@ -115,9 +115,17 @@ void momPrintMomr(MOMR *);
 
 void momClearLocr(LOCR *);
 double momLocrAddMomr5(LOCR *,MOMR *,momFloat,momFloat,momFloat,momFloat,double *,double *,double *);
+void momAddFlocr(FLOCR *lr,FLOCR *la);
+void momScaledAddFlocr(FLOCR *lr, Real vr, FLOCR *la, Real va);
+void momRescaleFlocr(FLOCR *lr, Real vnew, Real vold);
+double momShiftFlocr(FLOCR *l, Real v, Real x, Real y,
+                     Real z);
 double momFlocrAddFmomr5cm(FLOCR *l, Real v, FMOMR *m, Real u,
                            Real dir, Real x, Real y, Real z,
                            Real *tax, Real *tay, Real *taz);
+void momEvalFlocr(FLOCR *l, Real v, Real x, Real y, Real z,
+                  Real *fPot, Real *ax, Real *ay,
+                  Real *az);
 void momEvalLocr(LOCR *,momFloat,momFloat,momFloat,
 		 momFloat *,momFloat *,momFloat *,momFloat *);
 double momLocrAddMomr(LOCR *,MOMR *,momFloat,momFloat,momFloat,momFloat);
@@ -20,6 +20,7 @@ struct BoundingBox {
   Real pe;
   Real ke;
   Real mass;
+  double work; // sum of Particle::work
   static CkReduction::reducerType boxReducer;
 
   BoundingBox();
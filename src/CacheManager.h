@@ -6,13 +6,20 @@
 #include "Utility.h"
 #include "templates.h"
 #include "MultiData.h"
+#include "ConcurrentMap.h"
+#include "NumaAlloc.h"
+#include "ParticleArena.h"
+#include "ThreadStateHolder.h"
 
 #include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <mutex>
+#include <queue>
 
 extern CProxy_TreeSpec treespec;
+extern CProxy_ThreadStateHolder thread_state_holder;
 
 template <typename Data>
 struct NodePool {
@@ -20,56 +27,116 @@ struct NodePool {
   virtual Node<Data>* alloc(Key key, typename Node<Data>::Type type, int depth, int n_particles, Particle* particles, Node<Data>* parent, int tp_index, int cm_index) = 0;
   virtual Node<Data>* alloc(Key key, typename Node<Data>::Type type, SpatialNode<Data> spatial_node, Node<Data>* parent, Particle* particles, int tp_index, int cm_index) = 0;
   virtual void cleanup() = 0;
+  virtual void countPages(numa::PageStats& stats) const = 0;
+};
+
+// Chunks of nodes for the pools. The first chunk is allocated with the
+// first node rather than with the pool, so a pool that one rank creates
+// for another is placed on the NUMA node of the rank that fills it
+template <typename NodeType>
+class NodeChunks {
+public:
+  NodeChunks(size_t chunk_sizei) : chunk_size(chunk_sizei) { }
+  ~NodeChunks() {
+    for (auto& elem : list) numa::freeLocal(elem.ptr, sizeof(NodeType) * chunk_size);
+  }
+  NodeType* get(size_t n) {
+    if (list.empty()) {
+      home = numa::currentNode();
+      append();
+      curr = std::begin(list);
+    }
+    if (curr->idx + n > chunk_size) {
+      if (std::next(curr) == std::end(list)) append();
+      curr = std::next(curr);
+    }
+    auto buf = (NodeType*)(curr->ptr) + curr->idx;
+    curr->idx += n;
+    return buf;
+  }
+  void cleanup() {
+    for (auto& elem : list) elem.idx = 0;
+    curr = std::begin(list);
+  }
+  void countPages(numa::PageStats& stats) const {
+    for (auto& elem : list) numa::countPages(elem.ptr, sizeof(NodeType) * elem.idx, home, stats);
+  }
+private:
+  void append() {
+    list.emplace_back();
+    list.back().ptr = (char*) numa::allocLocal(sizeof(NodeType) * chunk_size);
+  }
+  struct PoolElem {
+    char * ptr = nullptr;
+    size_t idx = 0;
+  };
+  const size_t chunk_size;
+  int home = -1;
+  std::list<PoolElem> list;
+  typename std::list<PoolElem>::iterator curr;
 };
 
 template <typename Data, size_t BranchFactor>
 class FullNodePool : public NodePool<Data> {
 public:
   FullNodePool(size_t pool_elem_sizei)
-  : pool_elem_size(pool_elem_sizei)
+  : chunks(pool_elem_sizei)
   {
-    append();
-    curr = std::begin(list);
-  }
-  virtual ~FullNodePool() override {
-    for (auto& elem : list) delete[] elem.ptr;
   }
   virtual Node<Data>* alloc(Key key, typename Node<Data>::Type type, int depth, int n_particles, Particle* particles, Node<Data>* parent, int tp_index, int cm_index) override {
-    auto buf = getBuf();
+    auto buf = chunks.get(1);
     if (type == Node<Data>::Type::Leaf)  { // use this not (n_particles > 0)
       return new (buf) FullNode<Data, BranchFactor>(key, type, depth, n_particles, particles, parent, tp_index, cm_index);
     } else return new (buf) FullNode<Data, BranchFactor>(key, type, depth, parent, tp_index, cm_index);
   }
   virtual Node<Data>* alloc(Key key, typename Node<Data>::Type type, SpatialNode<Data> spatial_node, Node<Data>* parent, Particle* particles, int tp_index, int cm_index) override {
-    auto buf = getBuf();
+    auto buf = chunks.get(1);
     return new (buf) FullNode<Data, BranchFactor>(key, type, spatial_node, particles, parent, tp_index, cm_index);
   }
+  virtual void cleanup() override {
+    chunks.cleanup();
+  }
+  virtual void countPages(numa::PageStats& stats) const override {
+    chunks.countPages(stats);
+  }
 private:
-  char* getBuf() {
-    if (curr->idx == pool_elem_size) {
-      if (std::next(curr) == std::end(list)) append();
-      curr = std::next(curr);
-    }
-    auto buf = (FullNode<Data, BranchFactor>*)(curr->ptr) + curr->idx;
-    curr->idx++;
-    return (char*) buf;
+  NodeChunks<FullNode<Data, BranchFactor>> chunks;
+};
+
+// Allocates every child in its parent's block of BranchFactor siblings
+template <typename Data, size_t BranchFactor>
+class BlockNodePool : public NodePool<Data> {
+  using BlockNodeType = BlockNode<Data, BranchFactor>;
+public:
+  BlockNodePool(size_t pool_elem_sizei)
+  : chunks(std::max(pool_elem_sizei, BranchFactor))
+  {
+  }
+  virtual Node<Data>* alloc(Key key, typename Node<Data>::Type type, int depth, int n_particles, Particle* particles, Node<Data>* parent, int tp_index, int cm_index) override {
+    auto buf = getBuf(key, parent);
+    if (type == Node<Data>::Type::Leaf)  { // use this not (n_particles > 0)
+      return new (buf) BlockNodeType(key, type, depth, n_particles, particles, parent, tp_index, cm_index);
+    } else return new (buf) BlockNodeType(key, type, depth, parent, tp_index, cm_index);
+  }
+  virtual Node<Data>* alloc(Key key, typename Node<Data>::Type type, SpatialNode<Data> spatial_node, Node<Data>* parent, Particle* particles, int tp_index, int cm_index) override {
+    auto buf = getBuf(key, parent);
+    return new (buf) BlockNodeType(key, type, spatial_node, particles, parent, tp_index, cm_index);
   }
   virtual void cleanup() override {
-    for (auto& elem : list) elem.idx = 0;
-    curr = std::begin(list);
+    chunks.cleanup();
+  }
+  virtual void countPages(numa::PageStats& stats) const override {
+    chunks.countPages(stats);
   }
 private:
-  void append() {
-    list.emplace_back();
-    list.back().ptr = new char [sizeof(FullNode<Data, BranchFactor>) * pool_elem_size];
+  // A node without parent (the Subtree's root) gets a block of its own
+  BlockNodeType* getBuf(Key key, Node<Data>* parent) {
+    if (!parent) return chunks.get(1);
+    auto block_parent = static_cast<BlockNodeType*>(parent);
+    if (!block_parent->children) block_parent->children = chunks.get(BranchFactor);
+    return block_parent->children + key % BranchFactor;
   }
-  struct PoolElem {
-    char * ptr = nullptr;
-    size_t idx = 0;
-  };
-  const size_t pool_elem_size;
-  std::list<PoolElem> list;
-  typename std::list<PoolElem>::iterator curr;
+  NodeChunks<BlockNodeType> chunks;
 };
 
 template <typename Data>
@@ -77,36 +144,74 @@ class CacheManager : public CBase_CacheManager<Data> {
 public:
   std::mutex maps_lock;
   Node<Data>* root = nullptr;
-  using NodeLookup = std::unordered_map<Key, Node<Data>*>;
+  // The lookup tables are read by every PE of the node during the
+  // traversals, so they are lock-free instead of behind maps_lock
+  using NodeLookup = concurrent::ConcurrentMap<Node<Data>*>;
   size_t branch_factor = 0;
   NodeLookup local_tps;
   NodeLookup leaf_lookup; // all the cached leaves from copied subtrees
-  std::map<Key, std::vector<int>> subtree_copy_started;
-  std::map<int, Partition<Data>*> partition_lookup; // managed by Partition
-  std::set<Key> prefetch_set;
+  NodeLookup node_index; // the nodes of the cached tree, kept as they are swapped in
+  concurrent::ConcurrentMap<concurrent::WaitList*> subtree_copy_started; // tp_index -> waiting Partitions
+  concurrent::ConcurrentMap<Partition<Data>*> partition_lookup; // managed by Partition
+  std::vector<std::set<Key>> prefetch_sets; // per rank, merged by startParentPrefetch
+  std::map<int, std::set<Key>> retained_keys; // owner cm_index -> tops of the subtrees fetched from it
+  // requests served for nodes in each local node's subtree, this iteration per
+  // rank (merged by destroy) and last iteration
+  std::vector<std::unordered_map<Key, int>> request_counts;
+  std::unordered_map<Key, int> last_request_counts;
   std::vector<std::vector<Node<Data>*>> cached_leaves; // cached leaves left over
   std::vector<std::vector<Node<Data>*>> displaced_leaves; // leaves split between >1 Partitions
   std::vector<std::unique_ptr<NodePool<Data>>> pools;
+  std::vector<std::unique_ptr<ParticleArena>> particle_arenas; // cached and split leaves' particles, per rank
   CProxy_Resumer<Data> r_proxy;
-  Data nodewide_data;
+  std::vector<Data> nodewide_datas; // per rank, merged by startPrefetch
+  unsigned export_fields = paratreet::eExportAll; // shipped with the nodes served to remote caches
 
   CacheManager() { }
 
+  // Index into the per-rank vectors, which a group cache sizes to one
+  size_t localRank() { return this->isNodeGroup() ? CkMyRank() : 0; }
+
   void initialize(const CkCallback& cb) {
     auto node_size = this->isNodeGroup() ? CmiNodeSize(CkMyNode()) : 1;
     cached_leaves.resize(node_size);
     displaced_leaves.resize(node_size);
+    prefetch_sets.resize(node_size);
+    request_counts.resize(node_size);
+    nodewide_datas.resize(node_size);
     auto& config = paratreet::getConfiguration();
     branch_factor = config.branchFactor();
-    auto pool_elem_size = std::max(config.pool_elem_size, 128);
-    for (size_t i = 0; i < node_size; i++) {
-      if (branch_factor == 2) pools.emplace_back(new FullNodePool<Data, 2>(pool_elem_size));
-      else if (branch_factor == 8) pools.emplace_back(new FullNodePool<Data, 8>(pool_elem_size));
-      else CkAbort("Config branch factor is not 2 or 8. Update list in CacheMananger::initialize to handle this.");
-    }
+    for (size_t i = 0; i < node_size; i++) pools.emplace_back(makeNodePool());
+    for (size_t i = 0; i < node_size; i++) particle_arenas.emplace_back(new ParticleArena());
+    this->contribute(cb);
+  }
+
+  // Sizes the node lookups for the first iteration, before they are filled;
+  // destroy() regrows them for the later ones
+  void reserveLookups(int n_particles, const CkCallback& cb) {
+    auto& config = paratreet::getConfiguration();
+    size_t n_cms = this->isNodeGroup() ? CkNumNodes() : CkNumPes();
+    // Leaves are about half full, and about as many remote ones are cached as local ones
+    size_t n_leaves = 4 * size_t(n_particles) / std::max(1, config.max_particles_per_leaf) / n_cms;
+    leaf_lookup.reserve(n_leaves);
+    node_index.reserve(2 * n_leaves); // fewer internal nodes than leaves
     this->contribute(cb);
   }
 
+  // Subtrees keep their own pool so that their nodes outlive destroy().
+  // A contiguous pool allocates siblings in blocks, for trees built in place
+  NodePool<Data>* makeNodePool(bool contiguous = false) {
+    auto pool_elem_size = std::max(paratreet::getConfiguration().pool_elem_size, 128);
+    if (contiguous) {
+      if (branch_factor == 2) return new BlockNodePool<Data, 2>(pool_elem_size);
+      else if (branch_factor == 8) return new BlockNodePool<Data, 8>(pool_elem_size);
+    }
+    else if (branch_factor == 2) return new FullNodePool<Data, 2>(pool_elem_size);
+    else if (branch_factor == 8) return new FullNodePool<Data, 8>(pool_elem_size);
+    CkAbort("Config branch factor is not 2 or 8. Update list in CacheMananger::makeNodePool to handle this.");
+    return nullptr;
+  }
+
   void lockMaps() {
     if (this->isNodeGroup()) maps_lock.lock();
   }
@@ -119,7 +224,7 @@ public:
   }
 
   void addDisplacedLeaf(Node<Data>* leaf) {
-    displaced_leaves[CkMyRank()].push_back(leaf);
+    displaced_leaves[localRank()].push_back(leaf);
   }
 
 public:
@@ -130,7 +235,7 @@ public:
         auto new_leaf = makeCachedNode(cl->key, Node<Data>::Type::Remote, empty_sn, cl->parent, nullptr, cl->tp_index, cl->cm_index); // placeholder
         auto which_child = cl->key % branch_factor;
         cl->parent->exchangeChild(which_child, new_leaf);
-        cl->freeParticles();
+        node_index.assign(cl->key, new_leaf);
       }
       clv.clear();
     }
@@ -144,7 +249,7 @@ public:
     for (auto && dlv : displaced_leaves) {
       for (auto && dl : dlv) handleLeaf(dl);
     }
-    for (auto& l : leaf_lookup) handleLeaf(l.second);
+    leaf_lookup.forEach([&] (Key, Node<Data>* leaf) {handleLeaf(leaf);});
     for (auto& pair : partitions_to_request) {
       pp_holder.proxy[pair.first].requestParticleUpdates(this->thisIndex, pair.second);
     }
@@ -166,55 +271,77 @@ public:
     for (auto && dlv : displaced_leaves) {
       for (auto && dl : dlv) handleLeaf(dl);
     }
-    for (auto& l : leaf_lookup) handleLeaf(l.second);
+    leaf_lookup.forEach([&] (Key, Node<Data>* leaf) {handleLeaf(leaf);});
     if (replaced != particles_received.size()) CkAbort("broken");
   }
+  // restore keeps the keys of the fetched subtrees for requestRetained()
   void destroy(bool restore) {
-    for (auto& clv : cached_leaves) {
-      for (auto l : clv) l->freeParticles();
-      clv.clear();
+    if (!restore) retained_keys.clear();
+    last_request_counts.clear();
+    for (auto& rank_counts : request_counts) {
+      if (restore) {
+        for (auto && count : rank_counts) last_request_counts[count.first] += count.second;
+      }
+      rank_counts.clear();
     }
-    for (auto& l : leaf_lookup) l.second->freeParticles();
+    for (auto& clv : cached_leaves) clv.clear();
     for (auto& dlv : displaced_leaves) {
       dlv.clear();
     }
+    // Reported with the stats of the next iteration
+    for (auto& pool : pools) pool->countPages(thread_state_holder.ckLocalBranch()->node_pages);
     for (auto& pool : pools) pool->cleanup();
+    for (auto& arena : particle_arenas) arena->reset();
     local_tps.clear();
     leaf_lookup.clear();
+    node_index.clear();
+    subtree_copy_started.forEach([] (Key, concurrent::WaitList* out) {delete out;});
     subtree_copy_started.clear();
-    prefetch_set.clear();
+    for (auto& prefetch_set : prefetch_sets) prefetch_set.clear();
+    for (auto& nodewide_data : nodewide_datas) nodewide_data = Data();
 
 
     root = nullptr;
   }
 
   Node<Data>* makeNode(Key key, typename Node<Data>::Type type, int depth, int n_particles, Particle* particles, Node<Data>* parent, int tp_index, int cm_index) {
-    return pools[CkMyRank()]->alloc(key, type, depth, n_particles, particles, parent, tp_index, cm_index);
+    return pools[localRank()]->alloc(key, type, depth, n_particles, particles, parent, tp_index, cm_index);
   }
 
   Node<Data>* makeCachedNode(Key key, typename Node<Data>::Type type, SpatialNode<Data> spatial_node, Node<Data>* parent, const Particle* particlesToCopy, int tp_index, int cm_index) {
     Particle* particles = nullptr;
-    if (spatial_node.n_particles > 0) {
-      particles = new Particle [spatial_node.n_particles];
-      std::copy(particlesToCopy, particlesToCopy + spatial_node.n_particles, particles);
-    }
-    return pools[CkMyRank()]->alloc(key, type, spatial_node, parent, particles, tp_index, cm_index);
+    if (spatial_node.n_particles > 0) particles = copyParticles(particlesToCopy, spatial_node.n_particles);
+    return pools[localRank()]->alloc(key, type, spatial_node, parent, particles, tp_index, cm_index);
+  }
+
+  // Particles copied here live until destroy()
+  Particle* copyParticles(const Particle* particles, size_t n) {
+    return particle_arenas[localRank()]->copy(particles, n);
   }
 
   template <typename Visitor>
-  void startPrefetch(DPHolder<Data>, CkCallback);
+  void startPrefetch(DPHolder<Data>, Visitor, CkCallback);
   void startParentPrefetch(DPHolder<Data>, CkCallback);
   void prepPrefetch(Node<Data>*);
   void requestNodes(std::pair<Key, int>);
   void serviceRequest(Node<Data>*, int);
   void recvStarterPack(std::pair<Key, SpatialNode<Data>>* pack, int n, CkCallback);
   void addCache(MultiData<Data>);
+  void requestRetained();
+  void requestNodesBatch(std::vector<Key>, int, bool);
+  void addCacheBatch(std::vector<MultiData<Data>>, bool);
   void receiveSubtree(MultiData<Data>, PPHolder<Data>);
   void restoreData(std::pair<Key, SpatialNode<Data>>);
   void connect(Node<Data>*);
+  void setExportFields(unsigned, const CkCallback&);
 
 private:
+  void makeMsg(Node<Data>*, std::vector<Node<Data>*>&, std::vector<Particle>&);
   void makeMsgPerNode(int, std::vector<Node<Data>*>&, std::vector<Particle>&, Node<Data>*);
+  void makeMsgByBudget(std::vector<Node<Data>*>&, std::vector<Particle>&, Node<Data>*);
+  void countRequest(Key);
+  Node<Data>* findLocal(Key);
+  void retainKey(int, Key);
   Node<Data>* addCacheHelper(Particle*, int, std::pair<Key, SpatialNode<Data>>*, int, int, int, bool);
   void restoreDataHelper(std::pair<Key, SpatialNode<Data>>&, bool);
   void insertNode(Node<Data>*, bool, bool);
@@ -226,20 +353,26 @@ private:
 
 template <typename Data>
 template <typename Visitor>
-void CacheManager<Data>::startPrefetch(DPHolder<Data> dp_holder, CkCallback cb) {
-  dp_holder.proxy.template prefetch<Visitor>(nodewide_data, this->thisIndex, cb);
+void CacheManager<Data>::startPrefetch(DPHolder<Data> dp_holder, Visitor v, CkCallback cb) {
+  Data nodewide_data;
+  for (auto& data : nodewide_datas) nodewide_data += data;
+  dp_holder.proxy.template prefetch<Visitor>(v, nodewide_data, this->thisIndex, cb);
 }
 
 template <typename Data>
 void CacheManager<Data>::startParentPrefetch(DPHolder<Data> dp_holder, CkCallback cb) {
+  std::set<Key> prefetch_set;
+  for (auto& rank_set : prefetch_sets) prefetch_set.insert(rank_set.begin(), rank_set.end());
   std::vector<Key> request_list (prefetch_set.begin(), prefetch_set.end());
   dp_holder.proxy.request(request_list.data(), request_list.size(), this->thisIndex, cb);
 }
 
 template <typename Data>
 void CacheManager<Data>::prepPrefetch(Node<Data>* node) {
-  // THIS IS IN LOCK. make faster? TODO
-  nodewide_data += node->data;
+  // Each rank accumulates on its own, the merge happens once per prefetch
+  auto rank = localRank();
+  nodewide_datas[rank] += node->data;
+  auto& prefetch_set = prefetch_sets[rank];
   Key curr_key = node->key;
   while (curr_key > 1) {
     curr_key /= branch_factor;
@@ -265,21 +398,18 @@ void CacheManager<Data>::connect(Node<Data>* node, bool should_process) {
 
 template <typename Data>
 void CacheManager<Data>::connect(Node<Data>* node) {
-  lockMaps();
   // Store/connect the incoming Subtree's local root
-  local_tps.insert(std::make_pair(node->key, node));
+  local_tps.insert(node->key, node);
   prepPrefetch(node);
-  unlockMaps();
   // XXX: May need to call process() for dual tree walk
 }
 
 template <typename Data>
 void CacheManager<Data>::connect(Node<Data>* node, const std::vector<Node<Data>*>& leaves) {
-  lockMaps();
+  // The leaves go first: finding the root means they are all there
+  for (auto && leaf : leaves) leaf_lookup.insert(leaf->key, leaf);
   // Store/connect the incoming Subtree's local root
-  local_tps.insert(std::make_pair(node->key, node));
-  for (auto && leaf : leaves) leaf_lookup.emplace(leaf->key, leaf);
-  unlockMaps();
+  local_tps.insert(node->key, node);
 }
 
 template <typename Data>
@@ -294,32 +424,117 @@ void CacheManager<Data>::recvStarterPack(std::pair<Key, SpatialNode<Data>>* pack
 #if DEBUG
     CkPrintf("[CM %d] receiving node %d in starter pack\n", this->thisIndex, pack[i].first);
 #endif
-    // uncomment conditional if prefetch() is ever restored
-    // if (!local_tps.count(pack[i].first))
     restoreDataHelper(pack[i], false);
   }
-  if (n == 0) root = local_tps[1];
+  if (n == 0) {
+    root = local_tps.find(1);
+    node_index.assign(1, root);
+  }
   CkAssert(root);
   this->contribute(cb);
 }
 
 template <typename Data>
 void CacheManager<Data>::receiveSubtree(MultiData<Data> multidata, PPHolder<Data> pp_holder) {
-  addCacheHelper(multidata.particles.data(), multidata.particles.size(), multidata.nodes.data(), multidata.nodes.size(), multidata.cm_index, multidata.tp_index, true);
-  lockMaps();
-  auto copy_out = subtree_copy_started[multidata.tp_index];
-  unlockMaps();
-  for (auto && partition : copy_out) {
+  addCacheHelper(multidata.particleData(), multidata.particleCount(), multidata.nodes.data(), multidata.nodes.size(), multidata.cm_index, multidata.tp_index, true);
+  // Partitions that come after the close see the copy in local_tps
+  auto waiting = new concurrent::WaitList;
+  auto out = subtree_copy_started.insert(multidata.tp_index, waiting);
+  if (out != waiting) delete waiting;
+  for (auto && partition : out->close()) {
     pp_holder.proxy[partition].makeLeaves(multidata.tp_index);
   }
 }
 
 template <typename Data>
 void CacheManager<Data>::addCache(MultiData<Data> multidata) {
-  Node<Data>* top_node = addCacheHelper(multidata.particles.data(), multidata.particles.size(), multidata.nodes.data(), multidata.nodes.size(), multidata.cm_index, multidata.tp_index, false);
+  Node<Data>* top_node = addCacheHelper(multidata.particleData(), multidata.particleCount(), multidata.nodes.data(), multidata.nodes.size(), multidata.cm_index, multidata.tp_index, false);
+  if (paratreet::getConfiguration().retain_cache) retainKey(multidata.cm_index, top_node->key);
   process(top_node);
 }
 
+template <typename Data>
+void CacheManager<Data>::retainKey(int cm_index, Key key) {
+  lockMaps();
+  retained_keys[cm_index].insert(key);
+  unlockMaps();
+}
+
+// Asks every owner, in one message, for fresh copies of the subtrees this
+// cache fetched last iteration, before the traversals start. The keys are
+// retained again as the copies arrive; those that no longer exist drop out
+template <typename Data>
+void CacheManager<Data>::requestRetained() {
+  std::map<int, std::set<Key>> requesting;
+  lockMaps();
+  std::swap(requesting, retained_keys);
+  unlockMaps();
+  for (auto && owner : requesting) {
+    std::vector<Key> keys (owner.second.begin(), owner.second.end());
+    this->thisProxy[owner.first].requestNodesBatch(keys, this->thisIndex, false);
+  }
+}
+
+// Serves several node requests with one reply. on_demand batches come
+// from traversals waiting on the nodes (see Resumer::requestNode), the
+// others from requestRetained(). Those come in increasing key order, so a
+// key already shipped inside an earlier subtree of the batch is dropped
+// before it takes up the byte budget again
+template <typename Data>
+void CacheManager<Data>::requestNodesBatch(std::vector<Key> keys, int cm_index, bool on_demand) {
+  if (cm_index == this->thisIndex) return; // you'll get it later!
+  std::vector<MultiData<Data>> batch;
+  std::unordered_set<Key> shipped;
+  for (auto key : keys) {
+    if (!on_demand && shipped.count(key)) continue;
+    Node<Data>* node = findLocal(key);
+    if (!node) {
+      if (on_demand) {
+        CkPrintf("CacheManager::requestNodesBatch: node not found for key %lu on cm %d\n", key, this->thisIndex);
+        CkAbort("CacheManager::requestNodesBatch: node not found");
+      }
+      continue;
+    }
+    std::vector<Node<Data>*> sending_nodes;
+    std::vector<Particle> sending_particles;
+    if (on_demand) countRequest(key);
+    makeMsg(node, sending_nodes, sending_particles);
+    if (!on_demand) {
+      for (auto sent : sending_nodes) shipped.insert(sent->key);
+    }
+    batch.emplace_back(nullptr, 0, sending_nodes.data(), sending_nodes.size(), this->thisIndex, node->tp_index);
+    batch.back().particles.swap(sending_particles);
+    batch.back().fields = export_fields;
+  }
+  this->thisProxy[cm_index].addCacheBatch(batch, on_demand);
+}
+
+template <typename Data>
+void CacheManager<Data>::addCacheBatch(std::vector<MultiData<Data>> batch, bool on_demand) {
+  if (on_demand) {
+    for (auto && multidata : batch) addCache(std::move(multidata));
+    return;
+  }
+  // Keys come in increasing order, so a subtree nested in another
+  // one from the same owner is inserted after it
+  for (auto && multidata : batch) {
+    Key key = multidata.nodes[0].first;
+    Node<Data>* placeholder = node_index.find(key);
+    if (!placeholder) continue; // the tree above changed shape
+    switch (placeholder->type) {
+      case Node<Data>::Type::Boundary:
+      case Node<Data>::Type::RemoteAboveTPKey:
+      case Node<Data>::Type::Remote:
+      case Node<Data>::Type::RemoteLeaf:
+        addCacheHelper(multidata.particleData(), multidata.particleCount(), multidata.nodes.data(), multidata.nodes.size(), multidata.cm_index, multidata.tp_index, false);
+        retainKey(multidata.cm_index, key);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
 template <typename Data>
 Node<Data>* CacheManager<Data>::addCacheHelper(Particle* particles, int n_particles, std::pair<Key, SpatialNode<Data>>* nodes, int n_nodes, int cm_index, int tp_index, bool add_to_tps) {
 #if DEBUG
@@ -328,7 +543,7 @@ Node<Data>* CacheManager<Data>::addCacheHelper(Particle* particles, int n_partic
 
   Node<Data>* first_node_placeholder_parent = nullptr;
   if (!add_to_tps) {
-    auto first_node_placeholder = (!add_to_tps) ? root->getDescendant(nodes[0].first) : nullptr;
+    auto first_node_placeholder = node_index.find(nodes[0].first);
     if (first_node_placeholder->type == Node<Data>::Type::CachedRemote
       || first_node_placeholder->type == Node<Data>::Type::CachedRemoteLeaf)
     {
@@ -358,7 +573,7 @@ Node<Data>* CacheManager<Data>::addCacheHelper(Particle* particles, int n_partic
   }
   if (add_to_tps) connect(first_node, leaves);
   else {
-    auto && clv = cached_leaves[CkMyRank()];
+    auto && clv = cached_leaves[localRank()];
     clv.insert(clv.end(), leaves.begin(), leaves.end());
     swapIn(first_node);
   }
@@ -367,10 +582,7 @@ Node<Data>* CacheManager<Data>::addCacheHelper(Particle* particles, int n_partic
 
 template <typename Data>
 void CacheManager<Data>::requestNodes(std::pair<Key, int> param) {
-  Key key = param.first;
-  Key temp = key;
-  while (!local_tps.count(temp)) temp /= branch_factor;
-  Node<Data>* node = local_tps[temp]->getDescendant(key);
+  Node<Data>* node = findLocal(param.first);
   if (!node) {
     CkPrintf("CacheManager::requestNodes: node not found for key %lu on cm %d\n", param.first, this->thisIndex);
     CkAbort("CacheManager::requestNodes: node not found");
@@ -378,6 +590,69 @@ void CacheManager<Data>::requestNodes(std::pair<Key, int> param) {
   serviceRequest(node, param.second);
 }
 
+// Finds a node in the local Subtrees, nullptr if none of them has it
+template <typename Data>
+Node<Data>* CacheManager<Data>::findLocal(Key key) {
+  for (Key temp = key; temp > 0; temp /= branch_factor) {
+    auto tp = local_tps.find(temp);
+    if (tp) return tp->getDescendant(key);
+  }
+  return nullptr;
+}
+
+template <typename Data>
+void CacheManager<Data>::makeMsg(Node<Data>* node, std::vector<Node<Data>*>& sending_nodes, std::vector<Particle>& sending_particles)
+{
+  if (paratreet::getConfiguration().cache_share_bytes > 0) makeMsgByBudget(sending_nodes, sending_particles, node);
+  else makeMsgPerNode(node->depth, sending_nodes, sending_particles, node);
+}
+
+template <typename Data>
+void CacheManager<Data>::countRequest(Key key)
+{
+  if (paratreet::getConfiguration().cache_share_bytes == 0) return;
+  auto& counts = request_counts[localRank()];
+  for (Key temp = key; temp > 0; temp /= branch_factor) counts[temp]++;
+}
+
+// Ships the requested node and, within config.cache_share_bytes, the
+// descendants whose subtrees were requested most often last iteration,
+// i.e. the ones requesters are most likely to open. Without statistics
+// this is a breadth-first walk. Parents always go before their children,
+// as addCacheHelper expects
+template <typename Data>
+void CacheManager<Data>::makeMsgByBudget(std::vector<Node<Data>*>& sending_nodes, std::vector<Particle>& sending_particles, Node<Data>* to_process)
+{
+  const size_t budget = paratreet::getConfiguration().cache_share_bytes;
+  const size_t node_bytes = sizeof(std::pair<Key, SpatialNode<Data>>);
+  using Candidate = std::pair<int, Node<Data>*>;
+  auto priority = [&] (Node<Data>* node) {
+    auto it = last_request_counts.find(node->key);
+    return Candidate(it == last_request_counts.end() ? 0 : it->second, node);
+  };
+  auto lower = [] (const Candidate& a, const Candidate& b) {
+    return a.first < b.first || (a.first == b.first && a.second->key > b.second->key);
+  };
+  std::priority_queue<Candidate, std::vector<Candidate>, decltype(lower)> candidates (lower);
+  candidates.push(priority(to_process));
+  size_t bytes = 0;
+  while (!candidates.empty()) {
+    Node<Data>* node = candidates.top().second;
+    candidates.pop();
+    bool is_leaf = node->type == Node<Data>::Type::Leaf;
+    size_t size = node_bytes + (is_leaf ? node->n_particles * sizeof(Particle) : 0);
+    if (!sending_nodes.empty() && bytes + size > budget) continue;
+    bytes += size;
+    sending_nodes.push_back(node);
+    if (is_leaf) {
+      std::copy(node->particles(), node->particles() + node->n_particles, std::back_inserter(sending_particles));
+    }
+    for (int i = 0; i < node->n_children; i++) {
+      candidates.push(priority(node->getChild(i)));
+    }
+  }
+}
+
 template <typename Data>
 void CacheManager<Data>::makeMsgPerNode(int start_depth, std::vector<Node<Data>*>& sending_nodes, std::vector<Particle>& sending_particles, Node<Data>* to_process)
 {
@@ -399,11 +674,25 @@ void CacheManager<Data>::serviceRequest(Node<Data>* node, int cm_index) {
   if (cm_index == this->thisIndex) return; // you'll get it later!
   std::vector<Node<Data>*> sending_nodes;
   std::vector<Particle> sending_particles;
-  makeMsgPerNode(node->depth, sending_nodes, sending_particles, node);
+  countRequest(node->key);
+  makeMsg(node, sending_nodes, sending_particles);
   MultiData<Data> multidata (sending_particles.data(), sending_particles.size(), sending_nodes.data(), sending_nodes.size(), this->thisIndex, node->tp_index);
+  multidata.fields = export_fields;
   this->thisProxy[cm_index].addCache(multidata);
 }
 
+// Fields of the particles and nodes served from now on, the union of what
+// the visitors of this iteration read (see ExportFieldsOf). Subtree copies
+// for Partitions always carry every field
+template <typename Data>
+void CacheManager<Data>::setExportFields(unsigned fields, const CkCallback& cb) {
+  export_fields = fields;
+  if (paratreet::getConfiguration().export_quantized && (fields & paratreet::eExportPosition)) {
+    export_fields |= paratreet::eExportQuantizedPositions;
+  }
+  this->contribute(cb);
+}
+
 template <typename Data>
 void CacheManager<Data>::restoreData(std::pair<Key, SpatialNode<Data>> param) {
   restoreDataHelper(param, true);
@@ -415,7 +704,7 @@ void CacheManager<Data>::restoreDataHelper(std::pair<Key, SpatialNode<Data>>& pa
   if (!should_process) CkPrintf("restoring data for node %d\n", param.first);
 #endif
   Key key = param.first;
-  Node<Data>* parent = (key == Key(1)) ? nullptr : root->getDescendant(key / branch_factor);
+  Node<Data>* parent = (key == Key(1)) ? nullptr : node_index.find(key / branch_factor);
   auto node = makeCachedNode(key, Node<Data>::Type::CachedBoundary, param.second, parent, nullptr, -1, -1);
   insertNode(node, true, false);
   connect(node, should_process);
@@ -423,13 +712,15 @@ void CacheManager<Data>::restoreDataHelper(std::pair<Key, SpatialNode<Data>>& pa
 
 template <typename Data>
 void CacheManager<Data>::swapIn(Node<Data>* to_swap) {
-  if (to_swap->key > 1) {
-    auto which_child = to_swap->key % branch_factor;
-    to_swap = to_swap->parent->exchangeChild(which_child, to_swap);
+  Key key = to_swap->key;
+  if (key > 1) {
+    auto which_child = key % branch_factor;
+    to_swap->parent->exchangeChild(which_child, to_swap);
   }
   else {
-    std::swap(root, to_swap);
+    root = to_swap;
   }
+  node_index.assign(key, to_swap);
 }
 
 template <typename Data>
@@ -442,9 +733,8 @@ void CacheManager<Data>::insertNode(Node<Data>* node, bool above_tp, bool should
     Key child_key = node->key * branch_factor + i;
     bool add_placeholder = false;
     if (above_tp) {
-      auto it = local_tps.find(child_key);
-      if (it != local_tps.end()) {
-        new_child = it->second;
+      new_child = local_tps.find(child_key);
+      if (new_child) {
         new_child->parent = node;
       }
       else {
@@ -459,6 +749,7 @@ void CacheManager<Data>::insertNode(Node<Data>* node, bool above_tp, bool should
       new_child = makeCachedNode(child_key, type, empty_sn, node, nullptr, -1, new_cm_index); // placeholder
     }
     node->exchangeChild(i, new_child);
+    node_index.assign(child_key, new_child);
   }
   if (should_swap) swapIn(node);
 }
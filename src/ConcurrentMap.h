@@ -0,0 +1,231 @@
+#ifndef PARATREET_CONCURRENTMAP_H_
+#define PARATREET_CONCURRENTMAP_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// Lookup tables shared by the PEs of an SMP node, without a global lock.
+// No Charm++ dependency.
+namespace concurrent {
+
+/// Map from an integer key to a pointer. Open addressing with linear
+/// probing: a key claims its slot with a CAS and keeps it until clear(),
+/// the value is published with a second CAS, so a null value means absent
+/// (and erase() only nulls it). Keys that find no free slot within
+/// kMaxProbes go to an overflow map under a mutex; clear() regrows the
+/// table so that the next round does not need it, and reserve() sizes it
+/// up front when the number of keys can be estimated.
+/// find/insert/assign/erase may run concurrently, forEach/clear/size/reserve may not.
+template <typename V>
+class ConcurrentMap {
+  static_assert(std::is_pointer<V>::value, "ConcurrentMap values are pointers");
+
+public:
+  explicit ConcurrentMap(size_t capacity = 1024) {allocate(capacity);}
+
+  V find(uint64_t key) const {
+    const Slot* slot = findSlot(key);
+    if (slot) return slot->value.load(std::memory_order_acquire);
+    if (has_overflow.load(std::memory_order_acquire)) {
+      std::lock_guard<std::mutex> guard (overflow_lock);
+      auto it = overflow.find(key);
+      if (it != overflow.end()) return it->second;
+    }
+    return nullptr;
+  }
+
+  /// Inserts value unless key is present, returns the value stored for key
+  V insert(uint64_t key, V value) {
+    Slot* slot = claimSlot(key);
+    if (slot) {
+      V expected = nullptr;
+      if (slot->value.compare_exchange_strong(expected, value, std::memory_order_acq_rel)) return value;
+      return expected;
+    }
+    std::lock_guard<std::mutex> guard (overflow_lock);
+    has_overflow.store(true, std::memory_order_release);
+    auto& stored = overflow[key];
+    if (!stored) stored = value;
+    return stored;
+  }
+
+  /// Stores value for key, replacing the one it had
+  void assign(uint64_t key, V value) {
+    Slot* slot = claimSlot(key);
+    if (slot) {
+      slot->value.store(value, std::memory_order_release);
+      return;
+    }
+    std::lock_guard<std::mutex> guard (overflow_lock);
+    has_overflow.store(true, std::memory_order_release);
+    overflow[key] = value;
+  }
+
+  /// Removes key, returns the value it had
+  V erase(uint64_t key) {
+    Slot* slot = const_cast<Slot*>(findSlot(key));
+    if (slot) return slot->value.exchange(nullptr, std::memory_order_acq_rel);
+    if (has_overflow.load(std::memory_order_acquire)) {
+      std::lock_guard<std::mutex> guard (overflow_lock);
+      auto it = overflow.find(key);
+      if (it != overflow.end()) {
+        V value = it->second;
+        overflow.erase(it);
+        return value;
+      }
+    }
+    return nullptr;
+  }
+
+  template <typename Fn>
+  void forEach(const Fn& fn) const {
+    for (size_t i = 0; i <= mask; i++) {
+      V value = slots[i].value.load(std::memory_order_relaxed);
+      if (value) fn(slots[i].key.load(std::memory_order_relaxed), value);
+    }
+    for (auto && kv : overflow) fn(kv.first, kv.second);
+  }
+
+  size_t size() const {
+    size_t n = 0;
+    forEach([&] (uint64_t, V) {n++;});
+    return n;
+  }
+
+  /// Grows the table to hold n keys at the load clear() keeps
+  void reserve(size_t n) {
+    if (4 * n <= mask + 1) return;
+    std::vector<std::pair<uint64_t, V>> entries;
+    forEach([&] (uint64_t key, V value) {entries.emplace_back(key, value);});
+    overflow.clear();
+    has_overflow.store(false, std::memory_order_relaxed);
+    allocate(4 * n);
+    for (auto && entry : entries) assign(entry.first, entry.second);
+  }
+
+  void clear() {
+    size_t n = size();
+    bool grow = !overflow.empty() || 4 * n > mask + 1;
+    overflow.clear();
+    has_overflow.store(false, std::memory_order_relaxed);
+    if (grow) allocate(std::max(4 * n, 2 * (mask + 1)));
+    else {
+      for (size_t i = 0; i <= mask; i++) {
+        slots[i].key.store(kEmpty, std::memory_order_relaxed);
+        slots[i].value.store(nullptr, std::memory_order_relaxed);
+      }
+    }
+  }
+
+private:
+  static constexpr uint64_t kEmpty = ~uint64_t(0);
+  static constexpr size_t kMaxProbes = 64;
+
+  struct Slot {
+    std::atomic<uint64_t> key {kEmpty};
+    std::atomic<V> value {nullptr};
+  };
+
+  std::unique_ptr<Slot[]> slots;
+  size_t mask = 0;
+  mutable std::mutex overflow_lock;
+  std::unordered_map<uint64_t, V> overflow;
+  std::atomic<bool> has_overflow {false};
+
+  void allocate(size_t capacity) {
+    size_t n = 64;
+    while (n < capacity) n *= 2;
+    slots.reset(new Slot[n]);
+    mask = n - 1;
+  }
+
+  /// SFC keys share long prefixes, so they are mixed (splitmix64)
+  static size_t hash(uint64_t key) {
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ull;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebull;
+    key ^= key >> 31;
+    return key;
+  }
+
+  /// Slot holding key, claimed if needed; nullptr if key goes to overflow
+  Slot* claimSlot(uint64_t key) {
+    for (size_t i = 0, h = hash(key); i < kMaxProbes; i++) {
+      Slot& slot = slots[(h + i) & mask];
+      uint64_t k = slot.key.load(std::memory_order_acquire);
+      if (k == kEmpty) {
+        if (slot.key.compare_exchange_strong(k, key, std::memory_order_acq_rel)) return &slot;
+      }
+      if (k == key) return &slot; // k is reloaded by a failed CAS
+    }
+    return nullptr;
+  }
+
+  const Slot* findSlot(uint64_t key) const {
+    for (size_t i = 0, h = hash(key); i < kMaxProbes; i++) {
+      const Slot& slot = slots[(h + i) & mask];
+      uint64_t k = slot.key.load(std::memory_order_acquire);
+      if (k == key) return &slot;
+      if (k == kEmpty) return nullptr;
+    }
+    return nullptr;
+  }
+};
+
+/// List of waiters that is closed once: push() fails after close(), so
+/// whoever closes it sees every waiter that got in, and the others know
+/// to go ahead themselves. A Treiber stack whose head becomes kClosed.
+class WaitList {
+public:
+  ~WaitList() {close();}
+
+  /// Returns false if the list is closed; first is set if the list was empty
+  bool push(int value, bool& first) {
+    Entry* entry = new Entry {value, nullptr};
+    Entry* head = this->head.load(std::memory_order_acquire);
+    do {
+      if (head == closed()) {
+        delete entry;
+        return false;
+      }
+      entry->next = head;
+    } while (!this->head.compare_exchange_weak(head, entry, std::memory_order_acq_rel));
+    first = head == nullptr;
+    return true;
+  }
+
+  /// Closes the list, returns the waiters in the order they arrived
+  std::vector<int> close() {
+    Entry* entry = head.exchange(closed(), std::memory_order_acq_rel);
+    std::vector<int> values;
+    if (entry == closed()) return values;
+    while (entry) {
+      values.push_back(entry->value);
+      Entry* next = entry->next;
+      delete entry;
+      entry = next;
+    }
+    std::reverse(values.begin(), values.end());
+    return values;
+  }
+
+private:
+  struct Entry {
+    int value;
+    Entry* next;
+  };
+  static Entry* closed() {return reinterpret_cast<Entry*>(uintptr_t(1));}
+  std::atomic<Entry*> head {nullptr};
+};
+
+} // namespace concurrent
+
+#endif // PARATREET_CONCURRENTMAP_H_
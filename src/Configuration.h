@@ -6,6 +6,7 @@
 
 #include "Loadable.h"
 #include "BoundingBox.h"
+#include "SpaceFillingCurve.h"
 
 template<typename T>
 class CProxy_Subtree;
@@ -28,6 +29,8 @@ namespace paratreet {
       eInvalid = 100
     };
 
+    using KeyType = sfc::KeyType;
+
     inline int branchFactorFromTreeType(TreeType t) {
       switch (t) {
         case TreeType::eOct: return 8;
@@ -81,6 +84,21 @@ namespace paratreet {
       }
     };
 
+    template <>
+    struct FieldConverter<KeyType> {
+      KeyType operator()(const char* val) {
+        std::string s(val);
+        using T = KeyType;
+        if (s == "morton") {
+          return T::eMorton;
+        } else if (s == "hilbert" || s == "peano") {
+          return T::eHilbert;
+        } else {
+          CmiAbort("-- invalid key type value, %s --", val);
+        }
+      }
+    };
+
     struct Configuration : public PUP::able, public Loadable {
         // how many subtrees do you want, at least
         int min_n_subtrees;
@@ -92,24 +110,70 @@ namespace paratreet {
         DecompType decomp_type;
         // enum for how to build the tree
         TreeType tree_type;
+        // enum for the space-filling curve of particle keys
+        KeyType key_type;
         // number of iterations to run the simulation for.
         int num_iterations;
         // how many nodes to share when requesting a node
         int num_share_nodes;
         // how many nodes of the global tree should be shared. 0 means all
         int cache_share_depth;
+        // if positive, ship remote subtrees of up to this many bytes instead of
+        // cache_share_depth levels, preferring nodes that were requested more last iteration
+        int cache_share_bytes;
+        // keep the keys of the remote subtrees fetched into the cache between
+        // iterations (until the next flush) and refetch them in bulk up front
+        int retain_cache;
+        // ship remote particle positions as 16-bit offsets in their leaf's box
+        // (only with CacheManager::setExportFields)
+        int export_quantized;
         // how many nodes in one pool element. nodes are stored in pools
         int pool_elem_size; 
+        // allocate the children of Subtree nodes as one contiguous block (BlockNode)
+        int block_nodes;
         // after how many iterations should we flush (re-do decomposition)
         int flush_period;
         // after what decomposition (max/avg) ratio should we flush
         int flush_max_avg_ratio;
+        // on a flush, shift the splitters of the Partitions from where they were and
+        // keep the Partitions and Subtrees instead of decomposing from scratch (SFC decomposition).
+        // Flushes for Subtrees over flush_max_avg_ratio still decompose from scratch
+        int incremental_flush;
+        // balance Partitions by the interactions their particles had in the last
+        // iteration instead of by particle count (SFC and k-d decompositions)
+        int work_weighted;
+        // keys probed per splitter in each round of the SFC splitter search, 1 means bisection
+        int decomp_probes;
+        // how far off a splitter may be, as a fraction of a Partition's share. 0 means exact
+        double decomp_tolerance;
+        // rebuild the Subtrees every this many iterations and refit them
+        // (recompute node data, keep the topology) in between. 0 or 1 means always rebuild.
+        // Only trees whose leaves are key ranges (oct and binary oct) are refit
+        int refit_period;
+        // a Subtree due for a refit is rebuilt from its own particles instead once more
+        // than this fraction of them left the key range of their leaf, unless any left
+        // the Subtree itself
+        double refit_max_moved;
         // after how many iterations should we re-balance load
         int lb_period;
+        // deepest timestep rung: a big step is 2^max_rung iterations and a particle
+        // on rung r is kicked every 2^(max_rung - r) of them. 0 means a single timestep
+        int max_rung;
+        // accuracy parameter of the rung criterion, timestep = eta * sqrt(soft / |a|)
+        double eta;
         // after how many requests per Partition should we pause that traversal
         int request_pause_interval;
+        // send requests for remote nodes to the same CacheManager in batches of up
+        // to this many keys, flushed behind the work already queued on the PE. 0 or 1 means one message per node
+        int request_batch_size;
         // after how many iterations should we pause that traversal
         int iter_pause_interval;
+        // if positive, traversals pause after running this many microseconds instead and
+        // are resumed by a per-PE scheduler that favors walks resumed on remote data
+        int traversal_slice_us;
+        // PEs that read the input file in bulk and send each Reader its share, spread
+        // evenly over the Readers. 0 means every Reader decodes its own share with TipsyReader
+        int io_readers;
         // filename representing initial conditions
         std::string input_file;
         // filename representing output conditions
@@ -122,6 +186,13 @@ namespace paratreet {
         int nReplicas;
         // Set a gravitational softening for all the particles
         double dSoft;
+        // Keep a structure-of-arrays copy of the particle fields used by leaf kernels
+        int soa_particles;
+        // Sort particles by key with a radix sort instead of std::sort; in tests/bench/sort_bench
+        // it wins on sorts of ~100K particles, as in a Subtree, and ties std::sort at 1M
+        int radix_sort;
+        // Split the radix sort across the PEs of an SMP node with CkLoop
+        int sort_ckloop;
 
         // we support loading config files with "-x"
         Configuration(const char* config_arg = "-x")
@@ -135,12 +206,27 @@ namespace paratreet {
           this->register_field("nParticlesPerLeafMax", "l", max_particles_per_leaf);
           this->register_field("achDecompType", "d", decomp_type);
           this->register_field("achTreeType", "t", tree_type);
+          this->register_field("achKeyType", nullptr, key_type);
           this->register_field("nIterations", "i", num_iterations);
           this->register_field("nShareNodes", "s", num_share_nodes);
           this->register_field("iCacheShareDepth", nullptr, cache_share_depth);
+          this->register_field("iCacheShareBytes", nullptr, cache_share_bytes);
+          this->register_field("bRetainCache", nullptr, retain_cache);
+          this->register_field("bExportQuantized", nullptr, export_quantized);
+          this->register_field("bBlockNodes", nullptr, block_nodes);
           this->register_field("iFlushPeriod", "u", flush_period);
           this->register_field("iFlushPeriodMaxAvgRatio", "r", flush_max_avg_ratio);
+          this->register_field("bIncrementalFlush", nullptr, incremental_flush);
+          this->register_field("bWorkWeighted", nullptr, work_weighted);
+          this->register_field("iDecompProbes", nullptr, decomp_probes);
+          this->register_field("dDecompTolerance", nullptr, decomp_tolerance);
+          this->register_field("iRefitPeriod", nullptr, refit_period);
+          this->register_field("dRefitMaxMoved", nullptr, refit_max_moved);
           this->register_field("iLbPeriod", "b", lb_period);
+          this->register_field("iRequestBatchSize", nullptr, request_batch_size);
+          this->register_field("iTraversalSliceUs", nullptr, traversal_slice_us);
+          this->register_field("iMaxRung", nullptr, max_rung);
+          this->register_field("dEta", nullptr, eta);
 
           this->register_field("bPeriodic", nullptr, periodic);
           this->register_field("dxPeriod", nullptr, fPeriod.x);
@@ -148,6 +234,10 @@ namespace paratreet {
           this->register_field("dzPeriod", nullptr, fPeriod.z);
           this->register_field("nReplicas", nullptr, nReplicas);
           this->register_field("dSoft", "e", dSoft);
+          this->register_field("bSoaParticles", nullptr, soa_particles);
+          this->register_field("bRadixSort", nullptr, radix_sort);
+          this->register_field("bSortCkLoop", nullptr, sort_ckloop);
+          this->register_field("nIoReaders", nullptr, io_readers);
           this->register_field("achInputFile", "f", input_file);
           this->register_field("achOutputFile", "v", output_file);
         }
@@ -169,20 +259,39 @@ namespace paratreet {
             p | max_particles_per_leaf;
             p | decomp_type;
             p | tree_type;
+            p | key_type;
             p | num_iterations;
             p | num_share_nodes;
             p | cache_share_depth;
+            p | cache_share_bytes;
+            p | retain_cache;
+            p | export_quantized;
             p | pool_elem_size;
+            p | block_nodes;
             p | flush_period;
             p | flush_max_avg_ratio;
+            p | incremental_flush;
+            p | work_weighted;
+            p | decomp_probes;
+            p | decomp_tolerance;
+            p | refit_period;
+            p | refit_max_moved;
             p | lb_period;
+            p | max_rung;
+            p | eta;
             p | request_pause_interval;
+            p | request_batch_size;
             p | iter_pause_interval;
+            p | traversal_slice_us;
+            p | io_readers;
             p | input_file;
             p | output_file;
             p | periodic;
             p | fPeriod;
             p | dSoft;
+            p | soa_particles;
+            p | radix_sort;
+            p | sort_ckloop;
         }
     };
 
@@ -228,6 +337,17 @@ namespace paratreet {
       }
     }
 
+    static std::string asString(KeyType t) {
+      switch (t) {
+        case KeyType::eMorton:
+          return "Morton";
+        case KeyType::eHilbert:
+          return "Peano-Hilbert";
+        default:
+          return "InvalidKeyType";
+      }
+    }
+
     static DecompType subtreeDecompForTree(TreeType t) {
       switch (t) {
         case TreeType::eOct:
@@ -58,6 +58,12 @@ struct Decomposition: public PUP::able {
 
   virtual int findSplitters(BoundingBox &universe, CProxy_Reader &readers, int min_n_splitters) = 0;
 
+  // Moves the splitters of the last findSplitters to balance the particles
+  // now on the Readers, keeping their number. Only SfcDecomposition does
+  virtual int shiftSplitters(BoundingBox &universe, CProxy_Reader &readers);
+
+  virtual void countSplitters(const std::vector<Particle>& particles, Reader* reader, const CkCallback& cb) {}
+
   virtual Key getTpKey(int idx) = 0;
 
   virtual void setArrayOpts(CkArrayOptions& opts, const std::vector<int>& partition_locations, bool collocate);
@@ -70,6 +76,11 @@ struct Decomposition: public PUP::able {
     return tp_keys;
   }
 
+  bool work_weighted = false; // balance Particle::work instead of particle counts, where supported
+  int split_probes = 1; // keys probed per splitter and round of the SFC splitter search
+  paratreet::KeyType key_type = paratreet::KeyType::eMorton; // curve of the keys made by assignKeys
+  double split_tolerance = 0; // how far off a splitter may be, as a fraction of one splitter's share
+
 protected:
   bool isSubtree() const {return is_subtree;}
 private:
@@ -89,6 +100,8 @@ struct SfcDecomposition : public Decomposition {
   virtual int getPartitionHome(int tp_index) override;
   virtual void countAssignments(const std::vector<GenericSplitter>& states, const std::vector<Particle>& particles, Reader* reader, const CkCallback& cb, bool weight_by_partition) override;
   virtual int findSplitters(BoundingBox &universe, CProxy_Reader &readers, int min_n_splitters) override;
+  virtual int shiftSplitters(BoundingBox &universe, CProxy_Reader &readers) override;
+  virtual void countSplitters(const std::vector<Particle>& particles, Reader* reader, const CkCallback& cb) override;
   virtual void alignSplitters(SfcDecomposition *);
   std::vector<Splitter> getSplitters();
   virtual void pup(PUP::er& p) override;
@@ -96,6 +109,10 @@ struct SfcDecomposition : public Decomposition {
 private:
   int parallelFindSplitters(BoundingBox &universe, CProxy_Reader &readers, int min_n_splitters);
   int serialFindSplitters(BoundingBox &universe, CProxy_Reader &readers, int min_n_splitters);
+  void searchSplitters(BoundingBox &universe, CProxy_Reader &readers, std::vector<GenericSplitter>& states);
+  double splitTolerance(const BoundingBox &universe, size_t n_states) const;
+  int setSplitters(CProxy_Reader &readers, const std::vector<GenericSplitter>& states);
+  void countProbes(const std::vector<GenericSplitter>& states, const std::vector<Particle>& particles, Reader* reader, const CkCallback& cb);
 
 protected:
   std::vector<Splitter> splitters;
@@ -114,6 +131,8 @@ struct OctDecomposition : public SfcDecomposition {
   virtual int flush(std::vector<Particle> &particles, const SendParticlesFn &fn) override;
   virtual void countAssignments(const std::vector<GenericSplitter>& states, const std::vector<Particle>& particles, Reader* reader, const CkCallback& cb, bool weight_by_partition) override;
   virtual int findSplitters(BoundingBox &universe, CProxy_Reader &readers, int min_n_splitters) override;
+  // Splitters are tree nodes here, they cannot be shifted
+  virtual int shiftSplitters(BoundingBox &universe, CProxy_Reader &readers) override {return Decomposition::shiftSplitters(universe, readers);}
   virtual void setArrayOpts(CkArrayOptions& opts, const std::vector<int>& partition_locations, bool collocate) override;
 };
 
@@ -161,6 +180,7 @@ protected:
   std::vector<int> bins_sizes;
   std::vector<int> partition_idxs;
   std::vector<Bin> bins;
+  std::vector<std::vector<Real>> work_bins; // Particle::work of bins, if work_weighted
 };
 
 struct KdDecomposition : public BinaryDecomposition {
@@ -172,6 +192,10 @@ struct KdDecomposition : public BinaryDecomposition {
   virtual void countAssignments(const std::vector<GenericSplitter>& states, const std::vector<Particle>& particles, Reader* reader, const CkCallback& cb, bool weight_by_partition) override;
   virtual void assign(Bin& parent, Bin& left, Bin& right, std::pair<int, Real> split) override;
   virtual std::vector<GenericSplitter> sortAndGetSplitters(BoundingBox &universe, CProxy_Reader &readers) override;
+
+private:
+  void bisectByWork(BoundingBox &universe, CProxy_Reader &readers, std::vector<GenericSplitter>& states);
+  void countWork(const std::vector<GenericSplitter>& states, Reader* reader, const CkCallback& cb);
 };
 
 struct LongestDimDecomposition : public BinaryDecomposition {
@@ -9,6 +9,7 @@
 #include <vector>
 
 #include <numeric>
+#include <queue>
 #include "Reader.h"
 #include "Splitter.h"
 #include "TreeCanopy.h"
@@ -43,6 +44,8 @@ public:
   int n_partitions;
   double start_time;
   std::vector<int> partition_locations;
+  bool refit_subtrees = false; // Next iteration refits instead of rebuilding
+  BoundingBox key_universe; // Universe the particle keys were last made in
 
   Driver(CProxy_CacheManager<Data> cache_manager_, CProxy_Resumer<Data> resumer_, CProxy_TreeCanopy<Data> calculator_) :
     cache_manager(cache_manager_), resumer(resumer_), calculator(calculator_), storage_sorted(false) {}
@@ -105,12 +108,14 @@ public:
       universe = *((BoundingBox*)result->getData());
       delete result;
       remakeUniverse();
+      cache_manager.reserveLookups(universe.n_particles, CkCallbackResumeThread());
       if (config.min_n_subtrees < CkNumPes() || config.min_n_partitions < CkNumPes()) {
         CkPrintf("WARNING: Consider increasing min_n_subtrees and min_n_partitions to at least #pes\n");
       }
       // Assign keys and sort particles locally
       start_time = CkWallTimer();
       readers.assignKeys(universe, CkCallbackResumeThread());
+      key_universe = universe;
       CkPrintf("Assigning keys and sorting particles: %.3lf ms\n",
         (CkWallTimer() - start_time) * 1000);
     } else CkWaitQD();
@@ -179,19 +184,58 @@ public:
         (CkWallTimer() - decomp_time) * 1000);
   }
 
+  // Rebalances the Partitions after a flush without recreating the arrays:
+  // the SFC splitters are shifted to the particles now on the Readers, which
+  // go back to the same Subtrees, and only the particles whose Partition
+  // changed end up in another Partition's leaves
+  void redecompose() {
+    double decomp_time = CkWallTimer();
+    CkWaitQD();
+
+    start_time = CkWallTimer();
+    n_partitions = treespec.ckLocalBranch()->getPartitionDecomposition()->shiftSplitters(universe, readers);
+    treespec.receiveDecomposition(CkCallbackResumeThread(),
+        CkPointer<Decomposition>(treespec.ckLocalBranch()->getPartitionDecomposition()), false);
+    CkPrintf("Shifting splitters for particle decompositions: %.3lf ms\n",
+        (CkWallTimer() - start_time) * 1000);
+
+    start_time = CkWallTimer();
+    readers.assignPartitions(n_partitions, partitions);
+    CkStartQD(CkCallbackResumeThread());
+    CkPrintf("Assigning particles to Partitions: %.3lf ms\n",
+        (CkWallTimer() - start_time) * 1000);
+
+    start_time = CkWallTimer();
+    readers.flush(n_subtrees, subtrees);
+    CkStartQD(CkCallbackResumeThread());
+    CkPrintf("Flushing particles to Subtrees: %.3lf ms\n",
+        (CkWallTimer() - start_time) * 1000);
+    CkPrintf("**Total Decomposition time: %.3lf ms\n",
+        (CkWallTimer() - decomp_time) * 1000);
+  }
+
   // Core iterative loop of the simulation
   void run(CkCallback cb) {
     auto& config = paratreet::getConfiguration();
     double total_time = 0;
+    Real timestep_size = 0;
+    if (config.work_weighted) thread_state_holder.setCountWork(true);
     for (int iter = 0; iter < config.num_iterations; iter++) {
       CkPrintf("\n* Iteration %d\n", iter);
+      // Each iteration is one substep of a big step of 2^max_rung substeps.
+      // Rungs whose timesteps end on this substep are active, all of them
+      // at the start of a big step
+      int substep = iter % (1 << config.max_rung);
+      int active_rung = substep == 0 ? 0 : config.max_rung - __builtin_ctz(substep);
       double iter_start_time = CkWallTimer();
       // Start tree build in Subtrees
       start_time = CkWallTimer();
       CkCallback timeCb (CkReductionTarget(Driver<Data>, reportTime), this->thisProxy);
-      subtrees.buildTree(partitions, timeCb);
+      if (refit_subtrees) subtrees.refitTree(partitions, key_universe, timeCb);
+      else subtrees.buildTree(partitions, timeCb);
       CkWaitQD();
-      CkPrintf("Tree build and sending leaves: %.3lf ms\n", (CkWallTimer() - start_time) * 1000);
+      CkPrintf("Tree %s and sending leaves: %.3lf ms\n", refit_subtrees ? "refit" : "build",
+          (CkWallTimer() - start_time) * 1000);
 
       // Meta data collections, first for max velo
       CkReductionMsg * msg, *msg2;
@@ -201,7 +245,9 @@ public:
       CkReduction::tupleElement* res = nullptr, *res2 = nullptr;
       msg->toTuple(&res, &numRedn);
       Real max_velocity = *(Real*)(res[0].data); // avoid max_velocity = 0.0
-      Real timestep_size = paratreet::getTimestep(universe, max_velocity);
+      // The base timestep is held for the whole big step
+      if (substep == 0) timestep_size = paratreet::getTimestep(universe, max_velocity);
+      thread_state_holder.setActiveRung(active_rung);
 
       ProxyPack<Data> proxy_pack (this->thisProxy, subtrees, partitions, cache_manager);
 
@@ -210,6 +256,10 @@ public:
       // use exactly one of these three commands to load the software cache
       paratreet::preTraversalFn(proxy_pack);
       CkWaitQD();
+      if (config.retain_cache) {
+        cache_manager.requestRetained();
+        CkWaitQD();
+      }
       CkPrintf("TreeCanopy cache loading: %.3lf ms\n",
           (CkWallTimer() - start_time) * 1000);
 
@@ -222,7 +272,7 @@ public:
       start_time = CkWallTimer();
 
       // Move the particles in Partitions
-      partitions.kick(timestep_size, CkCallbackResumeThread());
+      partitions.kick(timestep_size, active_rung, CkCallbackResumeThread());
 
       // Now track PE imbalance for memory reasons
       thread_state_holder.collectMetaData(CkCallbackResumeThread((void *&) msg2));
@@ -237,20 +287,41 @@ public:
           (ratio > config.flush_max_avg_ratio || numParticleShares * 10 > universe.n_particles) :
           (iter % config.flush_period == config.flush_period - 1);
       if (iter + 1 == config.num_iterations) complete_rebuild = false;
-      CkPrintf("[Meta] n_subtree = %d; timestep_size = %f; numPSParticleCopies = %d; numPSParticleShares = %d; sumPESize = %d; maxPESize = %d, avgPESize = %f; ratio = %f; maxVelocity = %f; rebuild = %s\n", n_subtrees, timestep_size, numParticleCopies, numParticleShares, sumPESize, maxPESize, avgPESize, ratio, max_velocity, (complete_rebuild? "yes" : "no"));
+      CkPrintf("[Meta] n_subtree = %d; timestep_size = %f; active_rung = %d; numPSParticleCopies = %d; numPSParticleShares = %d; sumPESize = %d; maxPESize = %d, avgPESize = %f; ratio = %f; maxVelocity = %f; rebuild = %s\n", n_subtrees, timestep_size, active_rung, numParticleCopies, numParticleShares, sumPESize, maxPESize, avgPESize, ratio, max_velocity, (complete_rebuild? "yes" : "no"));
       //End Subtree reduction message parsing
 
       paratreet::postIterationFn(universe, proxy_pack, iter);
 
+      // Refitting keeps the Subtrees where they are, so it needs leaves
+      // shared with the Partitions and no migration this iteration. Leaves
+      // have to be key ranges for Subtrees to tell how far their particles moved
+      bool load_balance = !complete_rebuild && config.lb_period > 0 && iter % config.lb_period == config.lb_period - 1;
+      bool matching_decomps = config.decomp_type == paratreet::subtreeDecompForTree(config.tree_type);
+      bool key_leaves = config.tree_type == paratreet::TreeType::eOct || config.tree_type == paratreet::TreeType::eBinaryOct;
+      bool refit = config.refit_period > 1 && matching_decomps && key_leaves && !complete_rebuild && !load_balance
+        && (iter + 1) % config.refit_period != 0;
+      // Only SFC Partitions can be rebalanced in place, see redecompose().
+      // The Subtrees keep their splitters, so PEs whose Subtrees grew too
+      // big need the full decomposition
+      bool incremental = complete_rebuild && config.incremental_flush
+        && config.decomp_type == paratreet::DecompType::eSfc && !matching_decomps
+        && ratio <= config.flush_max_avg_ratio;
+
+      int n_particles = universe.n_particles;
       CkReductionMsg* result;
-      partitions.perturb(timestep_size, CkCallbackResumeThread((void *&)result));
+      partitions.perturb(timestep_size, active_rung, refit, CkCallbackResumeThread((void *&)result));
       universe = *((BoundingBox*)result->getData());
       delete result;
       remakeUniverse();
-      partitions.rebuild(universe, subtrees, complete_rebuild); // 0.1s for example
+      // Deleted particles have to be taken out of the Subtrees
+      if (refit && universe.n_particles != n_particles) refit = false;
+      if (!refit) {
+        partitions.rebuild(universe, subtrees, complete_rebuild); // 0.1s for example
+        key_universe = universe;
+      }
       CkWaitQD();
       CkPrintf("Perturbations: %.3lf ms\n", (CkWallTimer() - start_time) * 1000);
-      if (!complete_rebuild && config.lb_period > 0 && iter % config.lb_period == config.lb_period - 1){
+      if (load_balance){
         start_time = CkWallTimer();
         //subtrees.pauseForLB(); // move them later
         partitions.pauseForLB();
@@ -259,18 +330,21 @@ public:
       }
       // Destroy subtrees and perform decomposition from scratch
       resumer.reset();
-      if (complete_rebuild) {
+      if (complete_rebuild && !incremental) {
         treespec.reset();
         subtrees.destroy();
         partitions.destroy();
         decompose(iter+1);
       } else {
         partitions.reset();
-        subtrees.reset();
+        if (!refit) subtrees.reset();
+        if (incremental) redecompose();
       }
+      refit_subtrees = refit;
 
       // Clear cache and other storages used in this iteration
-      cache_manager.destroy(true);
+      // The fetched subtrees stay where they are unless the Subtrees move
+      cache_manager.destroy((!complete_rebuild || incremental) && !load_balance);
       CkCallback statsCb (CkReductionTarget(Driver<Data>, countInts), this->thisProxy);
       thread_state_holder.collectAndResetStats(statsCb);
       storage.clear();
@@ -327,39 +401,33 @@ public:
     storage_sorted = true;
   }
 
+  // Sends CacheManager cm_index the canopy nodes that its Subtrees'
+  // combined data (nodewide_data) opens, and their children, top down
+  // so that every node's parent arrives before it. Replaces loadCache()
   template <typename Visitor>
-  void prefetch(Data nodewide_data, int cm_index, CkCallback cb) { // TODO
-    CkAssert(false);
-    // do traversal on the root, send everything
-    /*if (!storage_sorted) sortStorage();
-    std::queue<int> node_indices; // better for cache. plus no requirement here on order
-    node_indices.push(0);
-    std::vector<std::pair<Key, Data>> to_send;
-    Visitor v;
-    typename std::vector<std::pair<Key, Data> >::iterator it;
-
-    while (node_indices.size()) {
-      std::pair<Key, Data> node = storage[node_indices.front()];
-      node_indices.pop();
-      to_send.push_back(node);
-
-      Node<Data> dummy_node1, dummy_node2;
-      dummy_node1.data = node.second;
-      dummy_node2.data = nodewide_data;
-      if (v.cell(*dummy_node1, *dummy_node2)) {
-
-        for (int i = 0; i < BRANCH_FACTOR; i++) {
-          Key key = node.first * BRANCH_FACTOR + i;
-          auto comp = [] (auto && a, auto && b) {return a.first < b.first;};
-          it = std::lower_bound(storage.begin(), storage.end(), std::make_pair(key, Data()), comp);
-          if (it != storage.end() && it->first == key) {
-            node_indices.push(std::distance(storage.begin(), it));
-          }
-        }
+  void prefetch(Visitor v, Data nodewide_data, int cm_index, CkCallback cb) {
+    if (!storage_sorted) sortStorage();
+    auto comp = [] (const std::pair<Key, SpatialNode<Data>>& a, const Key & b) {return a.first < b;};
+    auto find = [&] (Key key) {
+      auto it = std::lower_bound(storage.begin(), storage.end(), key, comp);
+      return (it != storage.end() && it->first == key) ? &(*it) : nullptr;
+    };
+    auto& config = paratreet::getConfiguration();
+    SpatialNode<Data> target;
+    target.data = nodewide_data;
+    std::vector<std::pair<Key, SpatialNode<Data>>> to_send;
+    std::queue<std::pair<Key, SpatialNode<Data>>*> nodes;
+    if (auto root = find(Key(1))) nodes.push(root);
+    while (!nodes.empty()) {
+      auto node = nodes.front();
+      nodes.pop();
+      to_send.push_back(*node);
+      if (!v.open(node->second, target)) continue;
+      for (int i = 0; i < config.branchFactor(); i++) {
+        if (auto child = find(node->first * config.branchFactor() + i)) nodes.push(child);
       }
     }
     cache_manager[cm_index].recvStarterPack(to_send.data(), to_send.size(), cb);
-    */
   }
 
   void request(Key* request_list, int list_size, int cm_index, CkCallback cb) {
@@ -0,0 +1,36 @@
+#ifndef PARATREET_EXPORTFIELDS_H_
+#define PARATREET_EXPORTFIELDS_H_
+
+namespace paratreet {
+  // Fields of cached particles and nodes that a remote traversal reads.
+  // CacheManager::setExportFields picks the ones shipped to remote caches,
+  // usually from a visitor's ExportFields; keys are always shipped
+  enum ExportField : unsigned {
+    eExportPosition     = 1u << 0,
+    eExportMass         = 1u << 1,
+    eExportSoft         = 1u << 2,
+    eExportVelocity     = 1u << 3,
+    eExportDensity      = 1u << 4,
+    eExportPressure     = 1u << 5, // pressure_dVolume
+    eExportThermal      = 1u << 6, // u and u_predicted
+    eExportPotential    = 1u << 7,
+    eExportAcceleration = 1u << 8,
+    eExportIdentity     = 1u << 9, // order, partition_idx, rung and type
+    eExportNodeSmoothing = 1u << 16, // per-particle smoothing data of nodes (CentroidData::pps)
+    eExportQuantizedPositions = 1u << 31, // positions as 16-bit offsets in their leaf's box
+    eExportAll = ~eExportQuantizedPositions
+  };
+
+  /// Visitor::ExportFields if the visitor declares it, every field otherwise
+  template <typename Visitor, typename = void>
+  struct ExportFieldsOf {
+    static constexpr unsigned value = eExportAll;
+  };
+
+  template <typename Visitor>
+  struct ExportFieldsOf<Visitor, decltype(void(Visitor::ExportFields))> {
+    static constexpr unsigned value = Visitor::ExportFields;
+  };
+}
+
+#endif // PARATREET_EXPORTFIELDS_H_
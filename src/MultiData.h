@@ -4,22 +4,57 @@
 #include "Particle.h"
 #include "Node.h"
 #include "common.h"
+#include "ExportFields.h"
 #include "paratreet.decl.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <vector>
 #include <iterator>
 
+namespace paratreet {
+  /// Pups node data for a remote cache, through Data::pupExport if it has one
+  template <typename Data>
+  auto pupExport(PUP::er& p, Data& data, unsigned fields, int) -> decltype(data.pupExport(p, fields), void()) {
+    data.pupExport(p, fields);
+  }
+
+  template <typename Data>
+  void pupExport(PUP::er& p, Data& data, unsigned, long) {
+    p | data;
+  }
+}
+
 template <typename Data>
 struct MultiData {
   std::vector<Particle> particles;
   std::vector<std::pair<Key, SpatialNode<Data>>> nodes;
   int cm_index = -1;
   int tp_index = -1;
+  unsigned fields = paratreet::eExportAll; // what is shipped, see ExportFields.h
 
   MultiData();
   MultiData(Particle*, int, Node<Data>**, int, int, int);
   void pup(PUP::er& p);
   void clear();
+
+  // Points at particles owned by the sender instead of copying them; the
+  // storage only has to outlive the send, pup packs straight from it
+  void referenceParticles(Particle* p, int n) {
+    particles.clear();
+    particle_ref = p;
+    n_particle_ref = n;
+  }
+  Particle* particleData() {return particle_ref ? particle_ref : particles.data();}
+  int particleCount() const {return particle_ref ? n_particle_ref : particles.size();}
+
+private:
+  Particle* particle_ref = nullptr;
+  int n_particle_ref = 0;
+
+  void pupExport(PUP::er& p);
+  void pupQuantizedPositions(PUP::er& p);
 };
 
 template <typename Data>
@@ -29,7 +64,7 @@ template <typename Data>
 inline MultiData<Data>::MultiData(Particle* particlesi, int n_particles, Node<Data>** nodesi, int n_nodes, int cm_indexi, int tp_indexi) {
   cm_index      = cm_indexi;
   tp_index      = tp_indexi;
-  std::copy(particlesi, particlesi + n_particles, std::back_inserter(particles));
+  referenceParticles(particlesi, n_particles);
   std::transform(nodesi, nodesi + n_nodes, std::back_inserter(nodes), [] (Node<Data>* node) {
     SpatialNode<Data> copy = *node;
     return std::make_pair(node->key, copy);
@@ -38,16 +73,83 @@ inline MultiData<Data>::MultiData(Particle* particlesi, int n_particles, Node<Da
 
 template <typename Data>
 void MultiData<Data>::pup(PUP::er& p) {
-  p | particles;
-  p | nodes;
+  // Always unpacks into the owned vector
+  int n_particles = particleCount();
+  p | n_particles;
+  if (p.isUnpacking()) {
+    particle_ref = nullptr;
+    particles.resize(n_particles);
+  }
   p | cm_index;
   p | tp_index;
+  p | fields;
+  if (fields == paratreet::eExportAll) {
+    PUParray(p, particleData(), n_particles);
+    p | nodes;
+  }
+  else pupExport(p);
+}
+
+template <typename Data>
+void MultiData<Data>::pupExport(PUP::er& p) {
+  int n_nodes = nodes.size();
+  p | n_nodes;
+  if (p.isUnpacking()) nodes.resize(n_nodes);
+  for (auto& node : nodes) {
+    p | node.first;
+    p | node.second.depth;
+    p | node.second.n_particles;
+    paratreet::pupExport(p, node.second.data, fields, 0);
+  }
+  Particle* particles = particleData();
+  for (int i = 0; i < particleCount(); i++) particles[i].pupExport(p, fields);
+  if ((fields & paratreet::eExportPosition) && (fields & paratreet::eExportQuantizedPositions)) {
+    pupQuantizedPositions(p);
+  }
+}
+
+// Each leaf's positions as 16-bit fractions of the box of its particles
+template <typename Data>
+void MultiData<Data>::pupQuantizedPositions(PUP::er& p) {
+  const Real steps = 65535;
+  Particle* particles = particleData();
+  int offset = 0;
+  for (auto& node : nodes) {
+    int n = node.second.n_particles;
+    if (n <= 0) continue;
+    Vector3D<Real> lo = particles[offset].position, hi = lo;
+    if (!p.isUnpacking()) {
+      for (int i = offset; i < offset + n; i++) {
+        for (int d = 0; d < 3; d++) {
+          lo[d] = std::min(lo[d], particles[i].position[d]);
+          hi[d] = std::max(hi[d], particles[i].position[d]);
+        }
+      }
+    }
+    p | lo;
+    p | hi;
+    for (int i = offset; i < offset + n; i++) {
+      uint16_t q[3];
+      for (int d = 0; d < 3; d++) {
+        Real extent = hi[d] - lo[d];
+        if (!p.isUnpacking()) q[d] = extent > 0 ? std::lround((particles[i].position[d] - lo[d]) / extent * steps) : 0;
+      }
+      PUParray(p, q, 3);
+      if (p.isUnpacking()) {
+        for (int d = 0; d < 3; d++) particles[i].position[d] = lo[d] + (hi[d] - lo[d]) * (q[d] / steps);
+      }
+    }
+    offset += n;
+  }
+  CkAssert(offset == particleCount());
 }
 
 template <typename Data>
 void MultiData<Data>::clear() {
   nodes.clear();
   particles.clear();
+  particle_ref = nullptr;
+  n_particle_ref = 0;
 }
 
 #endif // PARATREET_MULTIDATA_H_
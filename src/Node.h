@@ -2,6 +2,9 @@
 #define PARATREET_NODE_H_ 
 #include "common.h"
 #include "Particle.h"
+#include "ParticleSoA.h"
+#include "Utility.h"
+#include <algorithm>
 #include <array>
 #include <atomic>
 
@@ -36,6 +39,9 @@ public:
   void applyPotential(int index, Real pot) {
     particles_[index].potential += pot;
   }
+  void addWork(Real work) {
+    for (int i = 0; i < n_particles; i++) particles_[i].work += work;
+  }
 
   void pup (PUP::er& p) {
     p | depth;
@@ -49,24 +55,52 @@ public:
   int       depth = -1;
   inline const Particle* particles() const {return particles_;}
 
+  // Hot fields of this leaf's particles, if its Subtree/Partition keeps
+  // a ParticleSoA (see Configuration::soa_particles)
+  inline bool hasHotParticles() const {return soa_ != nullptr;}
+  inline ParticleSoA::View hot() const {return soa_->view(soa_offset_);}
+  void setHotParticles(ParticleSoA* soa, size_t offset) {
+    soa_ = soa;
+    soa_offset_ = offset;
+  }
+
 private:
   Particle* particles_ = nullptr;
+  ParticleSoA* soa_ = nullptr;
+  size_t soa_offset_ = 0;
 
 public:
-  void freeParticles() {
-    if (n_particles > 0 && particles_) {
-      delete[] particles_;
-      particles_ = nullptr;
+  void flushHotParticles() {
+    if (soa_ && n_particles > 0) {
+      soa_->flushAccelerations(particles_, soa_offset_, n_particles);
+    }
+  }
+  // Timesteps are the base timestep scaled down by each particle's rung;
+  // only particles on rung active_rung or above are kicked
+  bool isActive(int active_rung) const {
+    for (int i = 0; i < n_particles; i++) {
+      if (particles_[i].isActive(active_rung)) return true;
     }
+    return false;
   }
-  void kick(Real timestep) {
+  void kick(Real timestep, int active_rung) {
     for (int i = 0; i < n_particles; i++) {
-      particles_[i].kick(timestep);
+      auto& p = particles_[i];
+      if (p.isActive(active_rung)) p.kick(p.rungTimestep(timestep));
     }
   }
-  void perturb(Real timestep) {
+  void perturb(Real timestep, Real drift_timestep, int active_rung) {
     for (int i = 0; i < n_particles; i++) {
-      particles_[i].perturb(timestep);
+      auto& p = particles_[i];
+      p.perturb(p.isActive(active_rung) ? p.rungTimestep(timestep) : 0, drift_timestep);
+    }
+  }
+  // An active particle can move to a smaller rung only if its new, longer
+  // timestep starts on this substep, i.e. not below active_rung
+  void setRungs(Real timestep, int active_rung, Real eta, int max_rung) {
+    for (int i = 0; i < n_particles; i++) {
+      auto& p = particles_[i];
+      if (p.isActive(active_rung)) p.rung = std::max(active_rung, p.desiredRung(timestep, eta, max_rung));
     }
   }
 };
@@ -135,11 +169,7 @@ public:
   {
   }
 
-  virtual ~Node() {
-    if (type == Type::CachedRemoteLeaf) {
-      this->freeParticles();
-    }
-  }
+  virtual ~Node() = default;
 
 public:
   const int n_children;
@@ -221,6 +251,22 @@ public:
   }
 };
 
+/// The descendant of from with key to_find, nullptr if it is not in the
+/// tree. The child indices are the digits of to_find below from's key
+template <size_t BRANCH_FACTOR, typename Data>
+Node<Data>* findDescendant(Node<Data>* from, Key to_find) {
+  static_assert((BRANCH_FACTOR & (BRANCH_FACTOR - 1)) == 0, "branch factor is a power of two");
+  constexpr int child_bits = __builtin_ctz(BRANCH_FACTOR);
+  int levels = (Utility::mssb64_pos(to_find) - Utility::mssb64_pos(from->key)) / child_bits;
+  Node<Data>* node = from;
+  for (int shift = (levels - 1) * child_bits; shift >= 0; shift -= child_bits) {
+    int child_idx = (to_find >> shift) & (BRANCH_FACTOR - 1);
+    if (node && child_idx < node->n_children) node = node->getChild(child_idx);
+    else return nullptr;
+  }
+  return node;
+}
+
 template <class Data, size_t BRANCH_FACTOR>
 class FullNode : public Node<Data>
 {
@@ -258,18 +304,7 @@ public:
     return children[child_idx].exchange(child, std::memory_order_relaxed);
   }
   virtual Node<Data>* getDescendant(Key to_find) override {
-    std::vector<int> remainders;
-    Key temp = to_find;
-    while (temp >= BRANCH_FACTOR * this->key) {
-      remainders.push_back(temp % BRANCH_FACTOR);
-      temp /= BRANCH_FACTOR;
-    }
-    Node<Data>* node = this;
-    for (int i = remainders.size()-1; i >= 0; i--) {
-      if (node && remainders[i] < node->n_children) node = node->getChild(remainders[i]);
-      else return nullptr;
-    }
-    return node;
+    return findDescendant<BRANCH_FACTOR>(this, to_find);
   }
 
 
@@ -277,4 +312,47 @@ private:
   std::array<std::atomic<Node<Data>*>, BRANCH_FACTOR> children; 
 };
 
+/// Node whose children are one contiguous block of BRANCH_FACTOR nodes:
+/// it keeps a single pointer instead of one per child, and the siblings a
+/// traversal visits one after the other are adjacent in memory.
+/// BlockNodePool places every child in its parent's block, so children
+/// cannot be exchanged afterwards; Subtrees, which build their nodes in
+/// place, use it (see Configuration::block_nodes), the cache does not.
+template <class Data, size_t BRANCH_FACTOR>
+class BlockNode : public Node<Data>
+{
+public:
+  virtual ~BlockNode() = default;
+
+  BlockNode(Key _key, typename Node<Data>::Type _type, const SpatialNode<Data>& _spatial_node, Particle* _particles, Node<Data>* _parent, int _tp_index, int _cm_index)
+  : Node<Data>(_key, _type, (_spatial_node.n_particles >= 0) ? 0 : BRANCH_FACTOR, _spatial_node, _particles, _parent, _tp_index, _cm_index)
+  {
+  }
+
+  BlockNode(Key _key, typename Node<Data>::Type _type, int _depth, int _n_particles, Particle* _particles, Node<Data>* _parent, int _tp_index, int _cm_index)
+    : Node<Data>(_n_particles, _particles, _depth, _parent, _type, _key, _tp_index, _cm_index)
+  {
+  }
+
+  BlockNode(Key _key, typename Node<Data>::Type _type, int _depth, Node<Data>* _parent, int _tp_index, int _cm_index)
+    : Node<Data>(_depth, (_type == Node<Data>::Type::EmptyLeaf) ? 0 : BRANCH_FACTOR, _parent, _type, _key, _tp_index, _cm_index)
+  {
+  }
+
+  virtual Node<Data>* getChild(int child_idx) const override {
+    CkAssert(child_idx < this->n_children);
+    return children ? children + child_idx : nullptr;
+  }
+  // Only storing a child at its own place in the block is allowed
+  virtual Node<Data>* exchangeChild(int child_idx, Node<Data>* child) override {
+    if (child != getChild(child_idx)) CkAbort("BlockNode children cannot be exchanged");
+    return child;
+  }
+  virtual Node<Data>* getDescendant(Key to_find) override {
+    return findDescendant<BRANCH_FACTOR>(this, to_find);
+  }
+
+  BlockNode* children = nullptr; // allocated by BlockNodePool with the first child
+};
+
 #endif // PARATREET_NODE_H_
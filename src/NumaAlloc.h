@@ -0,0 +1,124 @@
+#ifndef PARATREET_NUMAALLOC_H_
+#define PARATREET_NUMAALLOC_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef USE_LIBNUMA
+#include <numa.h>
+#include <numaif.h>
+#include <sched.h>
+#endif
+
+// Memory placed on the NUMA domain of the thread that allocates it. With
+// libnuma (build with USE_LIBNUMA=1) the pages are bound to the local node;
+// otherwise they are fresh anonymous pages, which the kernel places where
+// they are first touched, so the allocating rank must also initialize them.
+// No Charm++ dependency.
+namespace numa {
+
+/// NUMA node of the calling thread, -1 if unknown
+inline int currentNode() {
+#ifdef USE_LIBNUMA
+  if (numa_available() >= 0) return numa_node_of_cpu(sched_getcpu());
+#endif
+  return -1;
+}
+
+inline void* allocLocal(size_t bytes) {
+#ifdef USE_LIBNUMA
+  if (numa_available() >= 0) {
+    void* ptr = numa_alloc_local(bytes);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+  }
+#endif
+  void* ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) throw std::bad_alloc();
+  return ptr;
+}
+
+inline void freeLocal(void* ptr, size_t bytes) {
+  if (!ptr) return;
+#ifdef USE_LIBNUMA
+  if (numa_available() >= 0) {
+    numa_free(ptr, bytes);
+    return;
+  }
+#endif
+  munmap(ptr, bytes);
+}
+
+/// Pages on the home node vs. on other nodes. Pages not touched yet count
+/// as neither
+struct PageStats {
+  size_t local = 0;
+  size_t remote = 0;
+
+  PageStats& operator+=(const PageStats& other) {
+    local += other.local;
+    remote += other.remote;
+    return *this;
+  }
+};
+
+/// Adds the placement of up to max_samples pages of [ptr, ptr + bytes),
+/// spread evenly, to stats. Needs libnuma (move_pages); a no-op otherwise
+inline void countPages(const void* ptr, size_t bytes, int home, PageStats& stats, size_t max_samples = 256) {
+#ifdef USE_LIBNUMA
+  if (!ptr || bytes == 0 || home < 0) return;
+  const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+  uintptr_t first = reinterpret_cast<uintptr_t>(ptr) & ~(page_size - 1);
+  size_t n_pages = (reinterpret_cast<uintptr_t>(ptr) + bytes - first + page_size - 1) / page_size;
+  size_t stride = (n_pages + max_samples - 1) / max_samples;
+  std::vector<void*> pages;
+  for (size_t i = 0; i < n_pages; i += stride) pages.push_back(reinterpret_cast<void*>(first + i * page_size));
+  std::vector<int> status (pages.size());
+  // With no target nodes move_pages only reports where each page is
+  if (move_pages(0, pages.size(), pages.data(), nullptr, status.data(), 0) != 0) return;
+  for (int node : status) {
+    if (node == home) stats.local++;
+    else if (node >= 0) stats.remote++;
+  }
+#endif
+}
+
+/// Allocator for large arrays that should live on their owner's node.
+/// Arrays smaller than kMinBytes come from operator new
+template <typename T>
+struct LocalAllocator {
+  using value_type = T;
+  static constexpr size_t kMinBytes = size_t(1) << 20;
+
+  LocalAllocator() = default;
+  template <typename U> LocalAllocator(const LocalAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    size_t bytes = n * sizeof(T);
+    if (bytes < kMinBytes) return static_cast<T*>(::operator new(bytes));
+    return static_cast<T*>(allocLocal(bytes));
+  }
+  void deallocate(T* ptr, size_t n) {
+    size_t bytes = n * sizeof(T);
+    if (bytes < kMinBytes) ::operator delete(ptr);
+    else freeLocal(ptr, bytes);
+  }
+};
+
+template <typename T, typename U>
+bool operator==(const LocalAllocator<T>&, const LocalAllocator<U>&) {return true;}
+template <typename T, typename U>
+bool operator!=(const LocalAllocator<T>&, const LocalAllocator<U>&) {return false;}
+
+template <typename T>
+using LocalVector = std::vector<T, LocalAllocator<T>>;
+
+} // namespace numa
+
+#endif // PARATREET_NUMAALLOC_H_
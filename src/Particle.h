@@ -3,11 +3,13 @@
 
 #include "common.h"
 #include "BoundingBox.h"
+#include "ExportFields.h"
 
 struct Particle {
   Key key;
   int order;
   int partition_idx = 0; // Only used when Subtree and Partition have different decomp types
+  int rung = 0; // timestep is the base timestep / 2^rung
 
   Real mass;
   Real density;
@@ -21,6 +23,9 @@ struct Particle {
   Real pressure_dVolume = 0.;
   using Effect = std::pair<Vector3D<Real>, Real>; // accel, pressure
   Real u_predicted;
+  // interactions of the traversals that last targeted this particle, plus one.
+  // Weighs it in work-weighted decompositions (Configuration::work_weighted)
+  Real work = 1.;
 
   enum class Type : char {
     eStar = 1,
@@ -37,13 +42,18 @@ struct Particle {
   bool isDark() const {return type == Type::eDark;}
 
   void pup(PUP::er&) ;
+  void pupExport(PUP::er&, unsigned fields);
 
   void reset();
   void finishInit();
 
+  bool isActive(int active_rung) const {return rung >= active_rung;}
+  Real rungTimestep(Real base_timestep) const {return base_timestep / (1 << rung);}
+  int desiredRung(Real base_timestep, Real eta, int max_rung) const;
+
   void kick(Real timestep);
-  void perturb(Real timestep);
-  void adjustNewUniverse(OrientedBox<Real> universe);
+  void perturb(Real kick_timestep, Real drift_timestep);
+  void adjustNewUniverse(OrientedBox<Real> universe); // wraps the position, keys are made by Decomposition::assignKeys
 
   bool operator==(const Particle&) const;
   bool operator<=(const Particle&) const;
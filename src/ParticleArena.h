@@ -0,0 +1,64 @@
+#ifndef PARATREET_PARTICLEARENA_H_
+#define PARATREET_PARTICLEARENA_H_
+
+#include "Particle.h"
+#include "NumaAlloc.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+/// Bump allocator for the particles of cached and split leaves, which all
+/// live until the cache is destroyed. reset() only rewinds: the chunks are
+/// kept, so later iterations do not allocate. Chunks are allocated on first
+/// use, on the NUMA node of the rank using the arena. Not thread-safe, the
+/// CacheManager keeps one per rank.
+class ParticleArena {
+public:
+  explicit ParticleArena(size_t chunk_particlesi = 1 << 14)
+  : chunk_particles(chunk_particlesi)
+  {
+  }
+  ParticleArena(const ParticleArena&) = delete;
+  ParticleArena& operator=(const ParticleArena&) = delete;
+  ~ParticleArena() {
+    for (auto& chunk : chunks) numa::freeLocal(chunk.ptr, chunk.capacity * sizeof(Particle));
+  }
+
+  /// Copies n particles into the arena
+  Particle* copy(const Particle* particles, size_t n) {
+    if (n == 0) return nullptr;
+    Particle* dest = alloc(n);
+    std::uninitialized_copy(particles, particles + n, dest);
+    return dest;
+  }
+
+  void reset() {
+    for (auto& chunk : chunks) chunk.used = 0;
+    curr = 0;
+  }
+
+private:
+  struct Chunk {
+    Particle* ptr;
+    size_t capacity;
+    size_t used;
+  };
+  const size_t chunk_particles;
+  std::vector<Chunk> chunks;
+  size_t curr = 0;
+
+  Particle* alloc(size_t n) {
+    while (curr < chunks.size() && chunks[curr].used + n > chunks[curr].capacity) curr++;
+    if (curr == chunks.size()) {
+      size_t capacity = std::max(n, chunk_particles);
+      chunks.push_back(Chunk{(Particle*) numa::allocLocal(capacity * sizeof(Particle)), capacity, 0});
+    }
+    auto& chunk = chunks[curr];
+    Particle* ptr = chunk.ptr + chunk.used;
+    chunk.used += n;
+    return ptr;
+  }
+};
+
+#endif // PARATREET_PARTICLEARENA_H_
@@ -8,9 +8,11 @@
 struct ParticleMsg : public CMessage_ParticleMsg {
   Particle* particles;
   int n_particles;
+  Real time = 0; // snapshot time, set on the shares of a bulk load
 
   ParticleMsg();
   ParticleMsg(Particle* p, int n);
+  explicit ParticleMsg(int n); // particles are constructed by the sender
 };
 
 inline ParticleMsg::ParticleMsg() {
@@ -23,4 +25,8 @@ inline ParticleMsg::ParticleMsg(Particle* p, int n) {
   n_particles = n;
 }
 
+inline ParticleMsg::ParticleMsg(int n) {
+  n_particles = n;
+}
+
 #endif // PARATREET_PARTICLEMSG_H_
@@ -0,0 +1,73 @@
+#ifndef PARATREET_PARTICLESOA_H_
+#define PARATREET_PARTICLESOA_H_
+
+#include "common.h"
+
+#include <vector>
+
+// Structure-of-arrays copy of the particle fields read and written by the
+// leaf kernels (position, mass, soft, acceleration, potential). The full Particle
+// records stay where they are; leaves index into this store by offset.
+struct ParticleSoA {
+  struct View {
+    const Real* x;
+    const Real* y;
+    const Real* z;
+    const Real* mass;
+    const Real* soft;
+    Real* ax;
+    Real* ay;
+    Real* az;
+    Real* pot;
+  };
+
+  std::vector<Real> x, y, z, mass, soft;
+  std::vector<Real> ax, ay, az, pot;
+
+  size_t size() const {return mass.size();}
+
+  void clear() {
+    for (auto* v : {&x, &y, &z, &mass, &soft, &ax, &ay, &az, &pot}) v->clear();
+  }
+
+  template <typename ParticleT>
+  void append(const ParticleT* particles, size_t n) {
+    size_t start = size();
+    for (auto* v : {&x, &y, &z, &mass, &soft, &ax, &ay, &az, &pot}) v->resize(start + n, 0);
+    for (size_t i = 0; i < n; i++) {
+      const ParticleT& p = particles[i];
+      x[start + i]    = p.position.x;
+      y[start + i]    = p.position.y;
+      z[start + i]    = p.position.z;
+      mass[start + i] = p.mass;
+      soft[start + i] = p.soft;
+    }
+  }
+
+  template <typename ParticleT>
+  void assign(const ParticleT* particles, size_t n) {
+    clear();
+    append(particles, n);
+  }
+
+  // Only valid until the next append/assign
+  View view(size_t offset) {
+    return View{x.data() + offset, y.data() + offset, z.data() + offset,
+                mass.data() + offset, soft.data() + offset,
+                ax.data() + offset, ay.data() + offset, az.data() + offset,
+                pot.data() + offset};
+  }
+
+  // Adds the accumulated accelerations and potentials back into the
+  // particle records and clears them for the next traversal
+  template <typename ParticleT>
+  void flushAccelerations(ParticleT* particles, size_t offset, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      particles[i].acceleration += Vector3D<Real>(ax[offset + i], ay[offset + i], az[offset + i]);
+      particles[i].potential += pot[offset + i];
+      ax[offset + i] = ay[offset + i] = az[offset + i] = pot[offset + i] = 0;
+    }
+  }
+};
+
+#endif // PARATREET_PARTICLESOA_H_
@@ -0,0 +1,14 @@
+#ifndef PARATREET_PARTICLESORT_H_
+#define PARATREET_PARTICLESORT_H_
+
+#include "Particle.h"
+
+#include <vector>
+
+namespace paratreet {
+  // Sorts particles by key. Uses the radix sort from RadixSort.h when
+  // bRadixSort is set, split across the PEs of the node with bSortCkLoop
+  void sortParticles(std::vector<Particle>& particles);
+}
+
+#endif // PARATREET_PARTICLESORT_H_
@@ -25,9 +25,11 @@ struct Partition : public CBase_Partition<Data> {
   std::vector<Node<Data>*> leaves;
   std::vector<Node<Data>*> tree_leaves;
   std::vector<Particle> saved_particles;
+  ParticleSoA hot_particles; // for leaves not already covered by a Subtree's
   bool matching_decomps;
 
   std::vector<std::unique_ptr<Traverser<Data>>> traversers;
+  std::set<size_t> pending_resumes; // traversers paused with a resumeAfterPause on its way
   int n_partitions;
 
   std::map<int, std::vector<Key>> lookup_leaf_keys;
@@ -45,6 +47,7 @@ struct Partition : public CBase_Partition<Data> {
 
   template<typename Visitor> void startDown(Visitor v);
   template<typename Visitor> void startBasicDown(Visitor v);
+  template<typename Visitor> void startListDown(Visitor v);
   template<typename Visitor> void startUpAndDown(Visitor v);
   void goDown(size_t travIdx);
   void resumeAfterPause(size_t travIdx);
@@ -54,8 +57,8 @@ struct Partition : public CBase_Partition<Data> {
   void receiveLeaves(std::vector<Key>, Key, int, TPHolder<Data>);
   void destroy();
   void reset();
-  void kick(Real, CkCallback);
-  void perturb(Real, CkCallback);
+  void kick(Real, int, CkCallback);
+  void perturb(Real, int, bool, CkCallback);
   void rebuild(BoundingBox, TPHolder<Data>, bool);
   void output(CProxy_Writer w, int n_total_particles, CkCallback cb);
   void output(CProxy_TipsyWriter w, int n_total_particles, CkCallback cb);
@@ -74,6 +77,7 @@ struct Partition : public CBase_Partition<Data> {
 
   Real time_advanced = 0;
   int iter = 1;
+  bool perturbed_in_place = false; // see perturb()
 
 private:
   std::set<int> particle_delete_order;
@@ -82,12 +86,19 @@ private:
   void initLocalBranches();
   void erasePartition();
   void copyParticles(std::vector<Particle>& particles, bool check_delete);
+  void makeHotParticles();
+  std::vector<Node<Data>*> activeLeaves() const;
   void startNewTraverser() {
     traversers.back()->start();
-    if (traversers.back()->wantsPause()) {
-      //CkPrintf("pausing trav %d\n", this->thisIndex);
-      this->thisProxy[this->thisIndex].resumeAfterPause(traversers.size() - 1);
-    }
+    if (traversers.back()->wantsPause()) pauseTraverser(traversers.size() - 1);
+  }
+  // Resumes the traverser later, through the Resumer's scheduler if
+  // traversals are time sliced. At most one resume is pending at a time
+  void pauseTraverser(size_t travIdx) {
+    //CkPrintf("pausing trav %d\n", this->thisIndex);
+    if (!pending_resumes.insert(travIdx).second) return;
+    if (paratreet::getConfiguration().traversal_slice_us > 0) r_local->schedulePaused(travIdx, this->thisIndex);
+    else this->thisProxy[this->thisIndex].resumeAfterPause(travIdx);
   }
   void flush(CProxy_Reader, std::vector<Particle>&);
   void makeLeaves(const std::vector<Key>&, int);
@@ -117,9 +128,7 @@ void Partition<Data>::initLocalBranches() {
   r_local = r_proxy.ckLocalBranch();
   r_local->part_proxy = this->thisProxy;
   cm_local = cm_proxy.ckLocalBranch();
-  cm_local->lockMaps();
-  cm_local->partition_lookup.emplace(this->thisIndex, this);
-  cm_local->unlockMaps();
+  cm_local->partition_lookup.insert(this->thisIndex, this);
   r_local->cm_local = cm_local;
   cm_local->r_proxy = r_proxy;
 }
@@ -129,18 +138,17 @@ template <typename Visitor>
 void Partition<Data>::startDown(Visitor v)
 {
   initLocalBranches();
-  traversers.emplace_back(new TransposedDownTraverser<Data, Visitor>(v, traversers.size(), leaves, *this));
+  makeHotParticles();
+  traversers.emplace_back(new TransposedDownTraverser<Data, Visitor>(v, traversers.size(), activeLeaves(), *this));
   startNewTraverser();
 }
 
 template <typename Data>
 void Partition<Data>::resumeAfterPause(size_t travIdx)
 {
+  pending_resumes.erase(travIdx);
   traversers[travIdx]->resumeAfterPause();
-  if (traversers[travIdx]->wantsPause()) {
-    //CkPrintf("pausing trav %d\n", this->thisIndex);
-    this->thisProxy[this->thisIndex].resumeAfterPause(travIdx);
-  }
+  if (traversers[travIdx]->wantsPause()) pauseTraverser(travIdx);
 }
 
 template <typename Data>
@@ -148,7 +156,19 @@ template <typename Visitor>
 void Partition<Data>::startBasicDown(Visitor v)
 {
   initLocalBranches();
-  traversers.emplace_back(new BasicDownTraverser<Data, Visitor>(v, traversers.size(), leaves, *this));
+  makeHotParticles();
+  traversers.emplace_back(new BasicDownTraverser<Data, Visitor>(v, traversers.size(), activeLeaves(), *this));
+  startNewTraverser();
+}
+
+template <typename Data>
+template <typename Visitor>
+void Partition<Data>::startListDown(Visitor v)
+{
+  // Only builds interaction lists, evaluate them with interact()
+  initLocalBranches();
+  makeHotParticles();
+  traversers.emplace_back(new InteractionListTraverser<Data, Visitor>(v, traversers.size(), activeLeaves(), *this));
   startNewTraverser();
 }
 
@@ -161,10 +181,28 @@ void Partition<Data>::startUpAndDown(Visitor v)
   startNewTraverser();
 }
 
+// Traversals only compute forces for leaves that are kicked this substep
+template <typename Data>
+std::vector<Node<Data>*> Partition<Data>::activeLeaves() const
+{
+  int active_rung = thread_state_holder.ckLocalBranch()->active_rung;
+  if (active_rung == 0) return leaves;
+  std::vector<Node<Data>*> active_leaves;
+  for (auto && leaf : leaves) {
+    if (leaf->isActive(active_rung)) active_leaves.push_back(leaf);
+  }
+  return active_leaves;
+}
+
 template <typename Data>
 void Partition<Data>::goDown(size_t travIdx)
 {
   traversers[travIdx]->resumeTrav();
+  // A time-sliced walk resumed on remote data can run out of its slice and
+  // park nodes too
+  if (paratreet::getConfiguration().traversal_slice_us > 0 && traversers[travIdx]->wantsPause()) {
+    pauseTraverser(travIdx);
+  }
 }
 
 template <typename Data>
@@ -221,8 +259,7 @@ void Partition<Data>::addLeaves(const std::vector<Node<Data>*>& leaf_ptrs, int s
         new_leaves.push_back(leaf);
       }
       else {
-        auto particles = new Particle [leaf_particles.size()];
-        std::copy(leaf_particles.begin(), leaf_particles.end(), particles);
+        auto particles = cm_local->copyParticles(leaf_particles.data(), leaf_particles.size());
         auto node = cm_local->makeNode(leaf->key, Node<Data>::Type::Leaf, leaf->depth,
           leaf_particles.size(), particles, nullptr, subtree_idx, cm_local->thisIndex);
         // note here: cm_index is of the old home, not the new home. not sure about this
@@ -241,35 +278,30 @@ void Partition<Data>::addLeaves(const std::vector<Node<Data>*>& leaf_ptrs, int s
 
 template <typename Data>
 void Partition<Data>::receiveLeaves(std::vector<Key> leaf_keys, Key tp_key, int subtree_idx, TPHolder<Data> tp_holder) {
-  cm_local->lockMaps();
-  auto && local_tps = cm_proxy.ckLocalBranch()->local_tps;
-  bool found = local_tps.find(tp_key) != local_tps.end();
-  if (found) {
-    cm_local->unlockMaps();
+  if (cm_local->local_tps.find(tp_key)) {
     makeLeaves(leaf_keys, subtree_idx);
+    return;
   }
-  else {
-    lookup_leaf_keys[subtree_idx] = leaf_keys;
-    auto& out = cm_local->subtree_copy_started[subtree_idx];
-    bool should_request = out.empty();
-    out.push_back(this->thisIndex);
-    cm_local->unlockMaps();
-    if (should_request) {
-      tp_holder.proxy[subtree_idx].requestCopy(cm_local->thisIndex, this->thisProxy);
-    }
+  lookup_leaf_keys[subtree_idx] = leaf_keys;
+  auto waiting = new concurrent::WaitList;
+  auto out = cm_local->subtree_copy_started.insert(subtree_idx, waiting);
+  if (out != waiting) delete waiting;
+  bool should_request = false;
+  // A closed list means the copy arrived after the local_tps check
+  if (!out->push(this->thisIndex, should_request)) makeLeaves(leaf_keys, subtree_idx);
+  else if (should_request) {
+    tp_holder.proxy[subtree_idx].requestCopy(cm_local->thisIndex, this->thisProxy);
   }
 }
 
 template <typename Data>
 void Partition<Data>::makeLeaves(const std::vector<Key>& keys, int subtree_idx) {
-  cm_local->lockMaps();
   std::vector<Node<Data>*> leaf_ptrs;
   for (auto && k : keys) {
-    auto it = cm_local->leaf_lookup.find(k);
-    CkAssert(it != cm_local->leaf_lookup.end());
-    leaf_ptrs.push_back(it->second);
+    auto leaf = cm_local->leaf_lookup.find(k);
+    CkAssert(leaf);
+    leaf_ptrs.push_back(leaf);
   }
-  cm_local->unlockMaps();
   addLeaves(leaf_ptrs, subtree_idx);
 }
 
@@ -292,12 +324,9 @@ template <typename Data>
 void Partition<Data>::reset()
 {
   traversers.clear();
-  for (int i = 0; i < leaves.size(); i++) {
-    if (leaves[i] != tree_leaves[i]) {
-      leaves[i]->freeParticles();
-    }
-  }
+  pending_resumes.clear();
   lookup_leaf_keys.clear();
+  hot_particles.clear();
   leaves.clear();
   tree_leaves.clear();
 }
@@ -320,26 +349,56 @@ void Partition<Data>::pup(PUP::er& p)
 
 template <typename Data>
 void Partition<Data>::erasePartition() {
-  cm_local->lockMaps();
   cm_local->partition_lookup.erase(this->thisIndex);
-  cm_local->unlockMaps();
 }
 
 template <typename Data>
-void Partition<Data>::kick(Real timestep, CkCallback cb)
+void Partition<Data>::kick(Real timestep, int active_rung, CkCallback cb)
 {
+  auto& config = paratreet::getConfiguration();
   for (auto && leaf : leaves) {
-    leaf->kick(timestep);
+    leaf->flushHotParticles();
+    leaf->kick(timestep, active_rung);
+    if (config.max_rung > 0) leaf->setRungs(timestep, active_rung, config.eta, config.max_rung);
   }
   this->contribute(cb);
 }
 
 template <typename Data>
-void Partition<Data>::perturb(Real timestep, CkCallback cb)
+void Partition<Data>::perturb(Real timestep, int active_rung, bool in_place, CkCallback cb)
 {
-  time_advanced += timestep;
+  // timestep is the base (rung 0) timestep, every particle drifts by one substep
+  Real drift_timestep = timestep / (1 << paratreet::getConfiguration().max_rung);
+  time_advanced += drift_timestep;
   iter += 1;
   BoundingBox box;
+  auto addToBox = [&] (const Particle& p) {
+    box.grow(p.position);
+    box.mass += p.mass;
+    box.ke += 0.5 * p.mass * p.velocity.lengthSquared();
+    box.work += p.work;
+    if (p.isGas()) box.n_sph++;
+    if (p.isDark()) box.n_dark++;
+    if (p.isStar()) box.n_star++;
+    box.n_particles++;
+  };
+
+  // When the Subtree is refit instead of rebuilt, the particles are moved
+  // where they are; rebuild() copies them out if it turns out to be needed
+  perturbed_in_place = in_place;
+  if (in_place) {
+    for (auto && leaf : leaves) {
+      leaf->perturb(timestep, drift_timestep, active_rung);
+      for (int i = 0; i < leaf->n_particles; i++) {
+        auto& p = leaf->particles()[i];
+        if (particle_delete_order.find(p.order) == particle_delete_order.end()) addToBox(p);
+      }
+    }
+    thread_state_holder.ckLocalBranch()->countPartitionParticles(box.n_particles);
+    this->contribute(sizeof(BoundingBox), &box, BoundingBox::reducer(), cb);
+    return;
+  }
+
   copyParticles(saved_particles, true);
 
   #if CMK_LB_USER_DATA
@@ -366,25 +425,24 @@ void Partition<Data>::perturb(Real timestep, CkCallback cb)
   #endif
 
   for (auto && p : saved_particles) {
-    p.perturb(timestep);
-    box.grow(p.position);
-    box.mass += p.mass;
-    box.ke += 0.5 * p.mass * p.velocity.lengthSquared();
-    if (p.isGas()) box.n_sph++;
-    if (p.isDark()) box.n_dark++;
-    if (p.isStar()) box.n_star++;
+    p.perturb(p.isActive(active_rung) ? p.rungTimestep(timestep) : 0, drift_timestep);
+    addToBox(p);
   }
-  box.n_particles = saved_particles.size();
   this->contribute(sizeof(BoundingBox), &box, BoundingBox::reducer(), cb);
 }
 
 template <typename Data>
 void Partition<Data>::rebuild(BoundingBox universe, TPHolder<Data> tp_holder, bool if_flush)
 {
+  if (perturbed_in_place) {
+    copyParticles(saved_particles, true);
+    perturbed_in_place = false;
+  }
   thread_state_holder.ckLocalBranch()->countPartitionParticles(saved_particles.size());
   for (auto && p : saved_particles) {
     p.adjustNewUniverse(universe.box);
   }
+  treespec.ckLocalBranch()->getPartitionDecomposition()->assignKeys(universe, saved_particles);
 
   if (if_flush) {
     flush(readers, saved_particles);
@@ -429,6 +487,27 @@ void Partition<Data>::copyParticles(std::vector<Particle>& particles, bool check
   }
 }
 
+template <typename Data>
+void Partition<Data>::makeHotParticles() {
+  if (!paratreet::getConfiguration().soa_particles) return;
+  // Leaves shared with a local Subtree already point into its store,
+  // only the ones split off in addLeaves need a copy here
+  std::vector<Node<Data>*> cold_leaves;
+  for (auto && leaf : leaves) {
+    if (leaf->n_particles > 0 && !leaf->hasHotParticles()) cold_leaves.push_back(leaf);
+  }
+  if (cold_leaves.empty()) return;
+  std::vector<size_t> offsets;
+  offsets.reserve(cold_leaves.size());
+  for (auto && leaf : cold_leaves) {
+    offsets.push_back(hot_particles.size());
+    hot_particles.append(leaf->particles(), leaf->n_particles);
+  }
+  for (int i = 0; i < cold_leaves.size(); i++) {
+    cold_leaves[i]->setHotParticles(&hot_particles, offsets[i]);
+  }
+}
+
 template <typename Data>
 void Partition<Data>::output(CProxy_Writer w, int n_total_particles, CkCallback cb)
 {
@@ -0,0 +1,214 @@
+#ifndef PARATREET_RADIXSORT_H_
+#define PARATREET_RADIXSORT_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// MSD radix sort of records by a 64-bit integer key. Only (key, index)
+// pairs are moved while sorting; each record is moved once afterwards,
+// through the sorted indices. Every level only looks at the key bits that
+// still differ within its range, so the placeholder bit and the prefix
+// shared by the keys of one subtree cost nothing. No Charm++ dependency:
+// callers pass a forEachChunk(n_chunks, fn) that runs fn(chunk) for every
+// chunk, possibly in parallel, and returns once all of them are done.
+namespace radix {
+
+struct KeyIndex {
+  uint64_t key;
+  size_t index;
+};
+
+constexpr int kTopDigitBits = 11; // First pass, over the whole range
+constexpr int kDigitBits = 8;     // Recursive passes, in cache
+constexpr size_t kInsertionSortMax = 32;
+
+struct Serial {
+  template <typename Fn>
+  void operator()(int n_chunks, const Fn& fn) const {
+    for (int c = 0; c < n_chunks; c++) fn(c);
+  }
+};
+
+inline size_t chunkBegin(size_t n, int n_chunks, int chunk) {
+  return n * chunk / n_chunks;
+}
+
+/// Bits below `bits` in which the keys of the range differ
+inline uint64_t varyingBits(const KeyIndex* pairs, size_t n, int bits) {
+  uint64_t any = 0, all = ~uint64_t(0);
+  for (size_t i = 0; i < n; i++) {
+    any |= pairs[i].key;
+    all &= pairs[i].key;
+  }
+  uint64_t mask = bits < 64 ? (uint64_t(1) << bits) - 1 : ~uint64_t(0);
+  return (any ^ all) & mask;
+}
+
+/// Shift that makes the digit end at the highest varying bit
+inline int digitShift(uint64_t varying, int digit_bits) {
+  int top = 63 - __builtin_clzll(varying);
+  return std::max(0, top + 1 - digit_bits);
+}
+
+inline void insertionSort(KeyIndex* pairs, size_t n) {
+  for (size_t i = 1; i < n; i++) {
+    KeyIndex x = pairs[i];
+    size_t j = i;
+    for (; j > 0 && pairs[j - 1].key > x.key; j--) pairs[j] = pairs[j - 1];
+    pairs[j] = x;
+  }
+}
+
+/// Sorts src[0, n) on the key bits below `bits`, leaving the result in dst
+/// if to_dst is set and in src otherwise; the other array is scratch
+inline void sortRange(KeyIndex* src, KeyIndex* dst, size_t n, int bits, bool to_dst) {
+  uint64_t varying = n > 1 ? varyingBits(src, n, bits) : 0;
+  if (n <= kInsertionSortMax || !varying) {
+    if (varying) insertionSort(src, n);
+    if (to_dst) std::copy(src, src + n, dst);
+    return;
+  }
+  constexpr int n_buckets = 1 << kDigitBits;
+  int shift = digitShift(varying, kDigitBits);
+  size_t count[n_buckets] = {}, offset[n_buckets];
+  for (size_t i = 0; i < n; i++) count[(src[i].key >> shift) & (n_buckets - 1)]++;
+  size_t sum = 0;
+  for (int d = 0; d < n_buckets; d++) {
+    offset[d] = sum;
+    sum += count[d];
+  }
+  for (size_t i = 0; i < n; i++) dst[offset[(src[i].key >> shift) & (n_buckets - 1)]++] = src[i];
+  // offset[d] is now the end of bucket d; the data is in dst
+  size_t begin = 0;
+  for (int d = 0; d < n_buckets; d++) {
+    if (count[d]) sortRange(dst + begin, src + begin, count[d], shift, !to_dst);
+    begin = offset[d];
+  }
+}
+
+/// Sorts pairs by key (scratch is reused between calls)
+template <typename ForEachChunk>
+void sortPairs(std::vector<KeyIndex>& pairs, std::vector<KeyIndex>& scratch,
+               int n_chunks, const ForEachChunk& forEachChunk) {
+  const size_t n = pairs.size();
+  if (n < 2) return;
+  n_chunks = std::max(1, std::min<int>(n_chunks, n));
+  scratch.resize(n);
+  constexpr int n_buckets = 1 << kTopDigitBits;
+
+  std::vector<uint64_t> any (n_chunks), all (n_chunks);
+  forEachChunk(n_chunks, [&] (int c) {
+    size_t begin = chunkBegin(n, n_chunks, c), end = chunkBegin(n, n_chunks, c + 1);
+    any[c] = 0;
+    all[c] = ~uint64_t(0);
+    for (size_t i = begin; i < end; i++) {
+      any[c] |= pairs[i].key;
+      all[c] &= pairs[i].key;
+    }
+  });
+  uint64_t varying = 0, common = ~uint64_t(0);
+  for (int c = 0; c < n_chunks; c++) {
+    varying |= any[c];
+    common &= all[c];
+  }
+  varying ^= common;
+  if (!varying) return;
+  int shift = digitShift(varying, kTopDigitBits);
+
+  // Top digit: per-chunk counts and a stable scatter into scratch
+  std::vector<std::vector<size_t>> offsets (n_chunks, std::vector<size_t>(n_buckets, 0));
+  forEachChunk(n_chunks, [&] (int c) {
+    auto& count = offsets[c];
+    for (size_t i = chunkBegin(n, n_chunks, c); i < chunkBegin(n, n_chunks, c + 1); i++) {
+      count[(pairs[i].key >> shift) & (n_buckets - 1)]++;
+    }
+  });
+  std::vector<size_t> bucket_begin (n_buckets + 1);
+  size_t sum = 0;
+  for (int d = 0; d < n_buckets; d++) {
+    bucket_begin[d] = sum;
+    for (int c = 0; c < n_chunks; c++) {
+      size_t count = offsets[c][d];
+      offsets[c][d] = sum;
+      sum += count;
+    }
+  }
+  bucket_begin[n_buckets] = n;
+  forEachChunk(n_chunks, [&] (int c) {
+    auto& offset = offsets[c];
+    for (size_t i = chunkBegin(n, n_chunks, c); i < chunkBegin(n, n_chunks, c + 1); i++) {
+      scratch[offset[(pairs[i].key >> shift) & (n_buckets - 1)]++] = pairs[i];
+    }
+  });
+
+  // Buckets are sorted back into pairs, each chunk takes the buckets
+  // that start in its share of the range
+  forEachChunk(n_chunks, [&] (int c) {
+    size_t begin = chunkBegin(n, n_chunks, c), end = chunkBegin(n, n_chunks, c + 1);
+    int d = std::lower_bound(bucket_begin.begin(), bucket_begin.end(), begin) - bucket_begin.begin();
+    for (; d < n_buckets && bucket_begin[d] < end; d++) {
+      size_t n_bucket = bucket_begin[d + 1] - bucket_begin[d];
+      if (n_bucket) {
+        sortRange(&scratch[bucket_begin[d]], &pairs[bucket_begin[d]], n_bucket, shift, true);
+      }
+    }
+  });
+}
+
+/// Sorts records by key_of(record), moving each record once. Keeps its
+/// (key, index) buffers between calls, so repeated sorts of similar sizes
+/// do not allocate them again. The records are gathered into a new array
+/// that replaces the caller's, whose old array is freed on return, so no
+/// second copy of the records outlives the sort.
+template <typename T>
+class Sorter {
+public:
+  template <typename KeyOf, typename ForEachChunk>
+  void sort(std::vector<T>& records, const KeyOf& key_of, int n_chunks,
+            const ForEachChunk& forEachChunk) {
+    const size_t n = records.size();
+    if (n < 2) return;
+    n_chunks = std::max(1, std::min<int>(n_chunks, n));
+
+    pairs.resize(n);
+    forEachChunk(n_chunks, [&] (int c) {
+      for (size_t i = chunkBegin(n, n_chunks, c); i < chunkBegin(n, n_chunks, c + 1); i++) {
+        pairs[i] = KeyIndex{key_of(records[i]), i};
+      }
+    });
+    sortPairs(pairs, scratch, n_chunks, forEachChunk);
+
+    // A gather has independent loads, unlike following permutation cycles
+    std::vector<T> sorted (n);
+    forEachChunk(n_chunks, [&] (int c) {
+      for (size_t i = chunkBegin(n, n_chunks, c); i < chunkBegin(n, n_chunks, c + 1); i++) {
+        sorted[i] = records[pairs[i].index];
+      }
+    });
+    records.swap(sorted);
+  }
+
+  template <typename KeyOf>
+  void sort(std::vector<T>& records, const KeyOf& key_of) {
+    sort(records, key_of, 1, Serial());
+  }
+
+  void release() {
+    std::vector<KeyIndex>().swap(pairs);
+    std::vector<KeyIndex>().swap(scratch);
+  }
+
+private:
+  std::vector<KeyIndex> pairs, scratch;
+};
+
+template <typename T, typename KeyOf>
+void sortByKey(std::vector<T>& records, const KeyOf& key_of) {
+  Sorter<T>().sort(records, key_of);
+}
+
+} // namespace radix
+
+#endif // PARATREET_RADIXSORT_H_
@@ -10,6 +10,11 @@
 #include "TreeSpec.h"
 #include "Modularization.h"
 
+namespace Tipsy {
+  class TipsyReader;
+  class header;
+}
+
 extern int n_readers;
 extern CProxy_TreeSpec treespec;
 
@@ -18,10 +23,22 @@ class Reader : public CBase_Reader {
   std::vector<ParticleMsg*> particle_messages;
   int particle_index;
 
+  // Bulk load (Configuration::io_readers): the share sent by an IO Reader
+  // may arrive before or after load() runs here
+  CkCallback load_cb;
+  bool loading = false;
+  ParticleMsg* load_msg = nullptr;
+
   static constexpr const Real gasConstant = 1.0;
   static constexpr const Real gammam1 = 5.0/3.0 - 1;
   static constexpr const Real meanMolWeight = 1.0;
 
+  void readParticles(Tipsy::TipsyReader& r, const Tipsy::header& tipsyHeader,
+      unsigned int start_particle, int n_particles, Particle* out);
+  void contributeBox(const CkCallback& cb);
+  void readShares(const std::string& input_file, int first_reader, int end_reader);
+  void finishLoad();
+
   public:
     Real start_time = 0;
     BoundingBox universe;
@@ -31,12 +48,14 @@ class Reader : public CBase_Reader {
 
     // Loading particles and assigning keys
     void load(std::string, const CkCallback&);
+    void receiveShare(ParticleMsg*);
     void setSoft(const double dSoft, const CkCallback&);
     void computeUniverseBoundingBox(const CkCallback& cb);
     void assignKeys(BoundingBox, const CkCallback&);
 
     void countAssignments(const std::vector<GenericSplitter>&, bool is_subtree, const CkCallback& cb, bool weight_by_partition);
     void doSplit(const std::vector<GenericSplitter>&, bool is_subtree, const CkCallback&);
+    void countSplitters(bool is_subtree, const CkCallback&);
 
     // SFC decomposition
     void getAllSfcKeys(const CkCallback& cb);
@@ -8,6 +8,7 @@
 #include <unordered_map>
 #include <vector>
 #include <queue>
+#include <deque>
 
 template <typename Data>
 class Resumer : public CBase_Resumer<Data> {
@@ -19,6 +20,32 @@ public: // these need to be seen by other local chares
   std::unordered_map<Key, std::vector<std::pair<int, int>>> waiting;
   bool use_subtree = false;
 
+private:
+  // Requests for entirely remote nodes, per owner CacheManager. They go
+  // out in one message when request_batch_size of them are waiting, or
+  // when the flush queued behind this PE's current work runs
+  std::map<int, std::vector<Key>> outgoing_requests;
+  CProxy_CacheManager<Data> request_cm_proxy;
+  int request_cm_index = -1;
+  bool flush_queued = false;
+
+  // Per-PE scheduler for time-sliced traversals (config.traversal_slice_us)
+  // of the Partitions on this PE, as (trav_idx, part_idx). Traversals
+  // resumed on remote data go first: they continue the walk below the
+  // nodes that just arrived and send the next requests out early. Paused
+  // local work fills the time in between. Every runScheduler message runs
+  // one slice, so incoming data is handled between slices
+  std::deque<std::pair<int, int>> resumed_work, paused_work;
+  bool scheduler_queued = false;
+
+  void queueScheduler() {
+    if (scheduler_queued) return;
+    scheduler_queued = true;
+    this->thisProxy[CkMyPe()].runScheduler();
+  }
+
+public:
+
   void reset() {
 #if DEBUG
     for (auto& trav : all_resume_nodes) {
@@ -28,12 +55,58 @@ public: // these need to be seen by other local chares
     CkAssert(waiting.empty()); // should have gotten rid of them
 #endif
     all_resume_nodes.clear();
+    CkAssert(!flush_queued);
+    CkAssert(resumed_work.empty() && paused_work.empty());
+  }
+
+  void schedulePaused(int trav_idx, int part_idx) {
+    paused_work.emplace_back(trav_idx, part_idx);
+    queueScheduler();
+  }
+
+  void runScheduler() {
+    scheduler_queued = false;
+    bool resumed = !resumed_work.empty();
+    auto& queue = resumed ? resumed_work : paused_work;
+    if (queue.empty()) return;
+    auto work = queue.front();
+    queue.pop_front();
+    Partition<Data>* part = cm_local->partition_lookup.find(work.second);
+    CkAssert(part);
+    if (resumed) part->goDown(work.first);
+    else part->resumeAfterPause(work.first);
+    if (!resumed_work.empty() || !paused_work.empty()) queueScheduler();
+  }
+
+  void requestNode(CProxy_CacheManager<Data> cm_proxy, int owner, Key key, int cm_index) {
+    request_cm_proxy = cm_proxy;
+    request_cm_index = cm_index;
+    auto& keys = outgoing_requests[owner];
+    keys.push_back(key);
+    if ((int) keys.size() >= paratreet::getConfiguration().request_batch_size) {
+      cm_proxy[owner].requestNodesBatch(keys, cm_index, true);
+      keys.clear();
+    }
+    else if (!flush_queued) {
+      flush_queued = true;
+      this->thisProxy[CkMyPe()].flushRequests();
+    }
+  }
+
+  void flushRequests() {
+    for (auto && owner : outgoing_requests) {
+      if (!owner.second.empty()) {
+        request_cm_proxy[owner.first].requestNodesBatch(owner.second, request_cm_index, true);
+      }
+    }
+    outgoing_requests.clear();
+    flush_queued = false;
   }
 
   void process(Key key) {
     auto it = waiting.find(key);
     if (it == waiting.end()) return;
-    auto node = cm_local->root->getDescendant(key);
+    auto node = cm_local->node_index.find(key);
     CkAssert(node && node->key == key);
     for (auto pair : it->second) { // (trav_idx, part_idx)
       auto && resume_nodes = all_resume_nodes[pair];
@@ -41,6 +114,10 @@ public: // these need to be seen by other local chares
       resume_nodes.push(node);
       if (should_resume) {
         if (use_subtree) subtree_proxy[pair.second].goDown(pair.first);
+        else if (paratreet::getConfiguration().traversal_slice_us > 0) {
+          resumed_work.push_back(pair);
+          queueScheduler();
+        }
         else part_proxy[pair.second].goDown(pair.first);
       }
     }
@@ -0,0 +1,138 @@
+#ifndef PARATREET_SPACEFILLINGCURVE_H_
+#define PARATREET_SPACEFILLINGCURVE_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Particle keys along a space-filling curve, 21 bits per dimension. Each
+// coordinate is mapped into [1, 2) of its box and the top 21 bits of its
+// float mantissa are used, as SFC::makeKey does, so Morton keys are the
+// ones SFC::generateKey makes. Every level of 3 key bits is an octant for
+// both curves, only the order of the octants differs, so trees built from
+// key prefixes work with either. Positions and boxes are any types with
+// x, y, z and lesser_corner, greater_corner. No Charm++ dependency.
+namespace sfc {
+
+enum class KeyType {
+  eMorton = 0, // z-order, x y z bits interleaved
+  eHilbert     // Peano-Hilbert, octants in the order of a continuous curve
+};
+
+constexpr int kBitsPerDim = 21;
+constexpr uint64_t kPlaceholderBit = uint64_t(1) << 63;
+
+/// Bits of a byte, spread three positions apart
+struct SpreadTable {
+  uint32_t entries[256];
+  constexpr SpreadTable() : entries() {
+    for (int i = 0; i < 256; i++) {
+      for (int b = 0; b < 8; b++) {
+        if (i & (1 << b)) entries[i] |= uint32_t(1) << (3 * b);
+      }
+    }
+  }
+};
+
+inline uint64_t spread(uint32_t v) {
+  static constexpr SpreadTable table {};
+  return uint64_t(table.entries[v & 0xff])
+    | (uint64_t(table.entries[(v >> 8) & 0xff]) << 24)
+    | (uint64_t(table.entries[(v >> 16) & 0x1f]) << 48);
+}
+
+/// Morton index of three 21-bit coordinates, x in the highest bit of each level
+inline uint64_t interleave(uint32_t x, uint32_t y, uint32_t z) {
+  return (spread(x) << 2) | (spread(y) << 1) | spread(z);
+}
+
+/// Turns n triples of 21-bit coordinates into the transposes of their
+/// Hilbert indices, whose interleaved bits are the indices (J. Skilling,
+/// "Programming the Hilbert curve", AIP Conf. Proc. 707, 2004). Branch-free
+/// with the levels outermost, so the loops over the batch vectorize
+inline void axesToTranspose(uint32_t* xs, uint32_t* ys, uint32_t* zs, size_t n) {
+  // Inverse undo: per axis, invert the lower bits of x where the axis has
+  // the level's bit, exchange them with the axis' where it does not
+  for (int level = kBitsPerDim - 1; level > 0; level--) {
+    const uint32_t p = (uint32_t(1) << level) - 1;
+    for (size_t i = 0; i < n; i++) {
+      uint32_t x = xs[i], y = ys[i], z = zs[i];
+      x ^= p & (0u - ((x >> level) & 1));
+      uint32_t set = 0u - ((y >> level) & 1);
+      x ^= p & set;
+      uint32_t t = (x ^ y) & p & ~set;
+      x ^= t;
+      y ^= t;
+      set = 0u - ((z >> level) & 1);
+      x ^= p & set;
+      t = (x ^ z) & p & ~set;
+      x ^= t;
+      z ^= t;
+      xs[i] = x;
+      ys[i] = y;
+      zs[i] = z;
+    }
+  }
+  // Gray encode
+  for (size_t i = 0; i < n; i++) {
+    uint32_t x = xs[i], y = ys[i] ^ xs[i];
+    uint32_t z = zs[i] ^ y;
+    uint32_t t = 0;
+    for (int level = kBitsPerDim - 1; level > 0; level--) {
+      t ^= ((uint32_t(1) << level) - 1) & (0u - ((z >> level) & 1));
+    }
+    xs[i] = x ^ t;
+    ys[i] = y ^ t;
+    zs[i] = z ^ t;
+  }
+}
+
+inline uint64_t hilbertIndex(uint32_t x, uint32_t y, uint32_t z) {
+  axesToTranspose(&x, &y, &z, 1);
+  return interleave(x, y, z);
+}
+
+/// Top 21 mantissa bits of the coordinate mapped into [1, 2) of [lesser, greater]
+template <typename T>
+inline uint32_t quantize(T v, T lesser, T greater) {
+  float d = float((v - lesser) / (greater - lesser) + T(1));
+  uint32_t bits;
+  std::memcpy(&bits, &d, sizeof(bits));
+  return (bits >> 2) & ((uint32_t(1) << kBitsPerDim) - 1);
+}
+
+/// Key of one position, without the placeholder bit
+template <typename Vector, typename Box>
+inline uint64_t generateKey(KeyType type, const Vector& v, const Box& box) {
+  uint32_t x = quantize(v.x, box.lesser_corner.x, box.greater_corner.x);
+  uint32_t y = quantize(v.y, box.lesser_corner.y, box.greater_corner.y);
+  uint32_t z = quantize(v.z, box.lesser_corner.z, box.greater_corner.z);
+  return type == KeyType::eHilbert ? hilbertIndex(x, y, z) : interleave(x, y, z);
+}
+
+/// Sets the key of n particles (anything with position and key) from their
+/// positions, with the placeholder bit. A batch of coordinates is quantized
+/// in one vectorizable loop before its keys are made
+template <typename ParticleT, typename Box>
+void generateKeys(KeyType type, ParticleT* particles, size_t n, const Box& box) {
+  constexpr size_t kBatch = 64;
+  uint32_t xs[kBatch], ys[kBatch], zs[kBatch];
+  for (size_t begin = 0; begin < n; begin += kBatch) {
+    const size_t m = std::min(kBatch, n - begin);
+    ParticleT* batch = particles + begin;
+    for (size_t i = 0; i < m; i++) {
+      xs[i] = quantize(batch[i].position.x, box.lesser_corner.x, box.greater_corner.x);
+      ys[i] = quantize(batch[i].position.y, box.lesser_corner.y, box.greater_corner.y);
+      zs[i] = quantize(batch[i].position.z, box.lesser_corner.z, box.greater_corner.z);
+    }
+    if (type == KeyType::eHilbert) {
+      axesToTranspose(xs, ys, zs, m);
+    }
+    for (size_t i = 0; i < m; i++) batch[i].key = interleave(xs[i], ys[i], zs[i]) | kPlaceholderBit;
+  }
+}
+
+} // namespace sfc
+
+#endif // PARATREET_SPACEFILLINGCURVE_H_
@@ -41,7 +41,12 @@ struct GenericSplitter {
   Key 	start_key = Key(0);
   Key 	end_key = (~Key(0));
   Key 	midKey() const {return start_key + (end_key - start_key) / 2;}
+  int 	n_probes = 1; // keys probed per round of the splitter search, at most end_key - start_key - 1
+  // j-th of the probes evenly spaced in the range; probeKey(-1) is start_key and
+  // probeKey(n_probes) at most end_key. With one probe it is midKey()
+  Key 	probeKey(int j) const {return start_key + (end_key - start_key) / (n_probes + 1) * (j + 1);}
   int 	goal_rank;
+  double goal_work = 0; // instead of goal_rank in work-weighted decompositions
   bool 	pending = true;
   int 	dim = -1;
   Real  start_float = 0;
@@ -51,6 +56,8 @@ struct GenericSplitter {
     p | start_key;
     p | end_key;
     p | goal_rank;
+    p | goal_work;
+    p | n_probes;
     p | pending;
     p | dim;
     p | start_float;
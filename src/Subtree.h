@@ -7,13 +7,17 @@
 #include "ParticleMsg.h"
 #include "NodeWrapper.h"
 #include "Node.h"
+#include "NumaAlloc.h"
 #include "Utility.h"
 #include "Reader.h"
 #include "CacheManager.h"
 #include "Resumer.h"
 #include "Driver.h"
 #include "OrientedBox.h"
+#include "ParticleSort.h"
+#include "SpaceFillingCurve.h"
 
+#include <algorithm>
 #include <cstring>
 #include <queue>
 #include <vector>
@@ -25,9 +29,12 @@ extern CProxy_Reader readers;
 template <typename Data>
 class Subtree : public CBase_Subtree<Data> {
 public:
-  std::vector<Particle> particles, incoming_particles;
+  numa::LocalVector<Particle> particles; // on the NUMA node of the PE that builds the tree
+  std::vector<Particle> incoming_particles;
+  std::vector<ParticleMsg*> incoming_msgs; // Held until buildTree merges them
   std::vector<Node<Data>*> leaves;
   std::vector<Node<Data>*> empty_leaves;
+  ParticleSoA hot_particles;
 
   int n_total_particles;
   int n_subtrees;
@@ -46,6 +53,7 @@ public:
   CacheManager<Data>* cm_local = nullptr;
 
   std::unique_ptr<Traverser<Data>> traverser;
+  std::unique_ptr<NodePool<Data>> node_pool; // Kept across iterations for refitTree
 
   std::vector<Particle> flushed_particles; // For debugging
 
@@ -56,7 +64,13 @@ public:
   };
   void receive(ParticleMsg*);
   void buildTree(CProxy_Partition<Data>, CkCallback);
+  void refitTree(CProxy_Partition<Data>, BoundingBox, CkCallback);
+  void mergeIncoming();
+  void buildLocalTree();
+  size_t countMovedParticles(const BoundingBox&, bool& left_subtree) const;
   void recursiveBuild(Node<Data>*, Particle*, size_t, size_t);
+  void resetNodeData(Node<Data>*);
+  void finishBuild(CProxy_Partition<Data>, CkCallback);
   void populateTree();
   inline void initCache();
   typename Node<Data>::Type getType(size_t num_particles, size_t max_particles_per_leaf) const;
@@ -64,6 +78,7 @@ public:
   void sendLeaves(CProxy_Partition<Data>);
   template <typename Visitor> void startDual(Visitor v);
   void goDown(size_t travIdx);
+  void interact(const CkCallback& cb);
   void requestNodes(Key, int);
   void requestCopy(int, PPHolder<Data>);
   void print(Node<Data>*);
@@ -144,20 +159,66 @@ void Subtree<Data>::pup(PUP::er& p) {
   p | tc_proxy;
   p | cm_proxy;
   p | r_proxy;
+  if (!p.isUnpacking()) {
+    // Migrating before the build, fold the held messages into the vector.
+    // Done on the sizing pass too, so it sizes what the packing pass writes
+    for (auto msg : incoming_msgs) {
+      incoming_particles.insert(incoming_particles.end(), msg->particles,
+                                msg->particles + msg->n_particles);
+      delete msg;
+    }
+    incoming_msgs.clear();
+  }
   p | incoming_particles;
   p | matching_decomps;
 }
 
 template <typename Data>
 void Subtree<Data>::receive(ParticleMsg* msg) {
-  // Copy particles to local vector
-  // TODO: Remove memcpy by just storing the pointer to msg->particles
-  // and using it in tree build
-  int initial_size = incoming_particles.size();
-  incoming_particles.resize(initial_size + msg->n_particles);
-  std::memcpy(&incoming_particles[initial_size], msg->particles,
-              msg->n_particles * sizeof(Particle));
-  delete msg;
+  // Keep the message, buildTree merges its particles in place
+  incoming_msgs.push_back(msg);
+}
+
+template <typename Data>
+void Subtree<Data>::mergeIncoming() {
+  // Each message is a key range of a sorted Reader or Partition buffer, so
+  // the runs are merged instead of concatenated and sorted again
+  if (!std::is_sorted(incoming_particles.begin(), incoming_particles.end())) {
+    paratreet::sortParticles(incoming_particles);
+  }
+  std::vector<std::pair<Particle*, Particle*>> runs;
+  size_t n_incoming = incoming_particles.size();
+  auto addRun = [&] (Particle* begin, Particle* end) {
+    if (begin == end) return;
+    if (!std::is_sorted(begin, end)) std::sort(begin, end);
+    runs.emplace_back(begin, end);
+  };
+  addRun(incoming_particles.data(), incoming_particles.data() + incoming_particles.size());
+  for (auto msg : incoming_msgs) {
+    addRun(msg->particles, msg->particles + msg->n_particles);
+    n_incoming += msg->n_particles;
+  }
+
+  particles.clear();
+  particles.reserve(n_incoming);
+  if (runs.size() == 1) {
+    particles.assign(runs[0].first, runs[0].second);
+  }
+  else if (!runs.empty()) {
+    auto later = [&runs] (int a, int b) {return *runs[b].first < *runs[a].first;};
+    std::priority_queue<int, std::vector<int>, decltype(later)> heads (later);
+    for (int i = 0; i < runs.size(); i++) heads.push(i);
+    while (!heads.empty()) {
+      int i = heads.top();
+      heads.pop();
+      particles.push_back(*runs[i].first);
+      if (++runs[i].first != runs[i].second) heads.push(i);
+    }
+  }
+
+  for (auto msg : incoming_msgs) delete msg;
+  incoming_msgs.clear();
+  incoming_particles.clear();
 }
 
 template <typename Data>
@@ -186,8 +247,8 @@ void Subtree<Data>::sendLeaves(CProxy_Partition<Data> part)
   // there is a consistant 1-on-1 mapping
   // partical.partition_idx is ignored
   if (matching_decomps) {
-    auto it = cm_proxy.ckLocalBranch()->partition_lookup.find(this->thisIndex);
-    it->second->addLeaves(leaves, this->thisIndex);
+    auto partition = cm_proxy.ckLocalBranch()->partition_lookup.find(this->thisIndex);
+    partition->addLeaves(leaves, this->thisIndex);
     return;
   }
 
@@ -206,10 +267,10 @@ void Subtree<Data>::sendLeaves(CProxy_Partition<Data> part)
 
   size_t num_shares = 0u, num_copies = 0;
   for (auto && part_receiver : part_idx_to_leaf) {
-    auto it = cm_proxy.ckLocalBranch()->partition_lookup.find(part_receiver.first);
-    if (it != cm_proxy.ckLocalBranch()->partition_lookup.end()) {
+    auto partition = cm_proxy.ckLocalBranch()->partition_lookup.find(part_receiver.first);
+    if (partition) {
       std::vector<Node<Data>*> leaf_ptrs (part_receiver.second.begin(), part_receiver.second.end());
-      it->second->addLeaves(leaf_ptrs, this->thisIndex);
+      partition->addLeaves(leaf_ptrs, this->thisIndex);
     }
     else {
       std::vector<Key> lookup_leaf_keys;
@@ -244,6 +305,12 @@ void Subtree<Data>::goDown(size_t travIdx) {
   traverser->resumeTrav();
 }
 
+template <typename Data>
+void Subtree<Data>::interact(const CkCallback& cb) {
+  if (traverser) traverser->interact();
+  this->contribute(cb);
+}
+
 template <typename Data>
 void Subtree<Data>::addNodeToFlatSubtree(Node<Data>* node) {
   SpatialNode<Data> sn (*node);
@@ -274,12 +341,14 @@ void Subtree<Data>::handlePossibleLeaf(Node<Data>* node) {
 
 template <typename Data>
 void Subtree<Data>::buildTree(CProxy_Partition<Data> part, CkCallback cb) {
-  // Copy over received particles
-  std::swap(particles, incoming_particles);
-
-  // Sort particles
-  std::sort(particles.begin(), particles.end());
+  // Merge received particles into key order
+  mergeIncoming();
+  buildLocalTree();
+  finishBuild(part, cb);
+}
 
+template <typename Data>
+void Subtree<Data>::buildLocalTree() {
   // Clear existing data
   leaves.clear();
   empty_leaves.clear();
@@ -290,20 +359,95 @@ void Subtree<Data>::buildTree(CProxy_Partition<Data> part, CkCallback cb) {
 #endif
   auto& config = paratreet::getConfiguration();
   Key lbf = log2(config.branchFactor());
+  if (!node_pool) node_pool.reset(cm_proxy.ckLocalBranch()->makeNodePool(config.block_nodes));
+  node_pool->cleanup();
   auto local_root_type = getType(particles.size(), config.max_particles_per_leaf);
-  local_root = cm_local->makeNode(tp_key, local_root_type,
+  local_root = node_pool->alloc(tp_key, local_root_type,
          Utility::getDepthFromKey(tp_key, lbf), particles.size(),
          particles.data(), nullptr, this->thisIndex, cm_local->thisIndex);
   if (local_root->isLeaf()) handlePossibleLeaf(local_root);
   else recursiveBuild(local_root, &particles[0], particles.size(), lbf);
+}
+
+template <typename Data>
+void Subtree<Data>::refitTree(CProxy_Partition<Data> part, BoundingBox key_universe, CkCallback cb) {
+  // Particles were moved in place by Partition::perturb and each one stays
+  // in its leaf, so the topology is kept and only node data is recomputed.
+  // Boxes grow to cover particles that left their leaf's key range; once
+  // too many did, the tree is rebuilt from new keys in the same universe.
+  // A particle that left the Subtree has a key outside tp_key, which
+  // recursiveBuild cannot place, so then the tree is only refit until the
+  // periodic full build (see Configuration::refit_period) moves it.
+  CkAssert(local_root && incoming_msgs.empty() && incoming_particles.empty());
+  auto& config = paratreet::getConfiguration();
+  flat_subtree.clear();
+  bool left_subtree = false;
+  size_t n_moved = countMovedParticles(key_universe, left_subtree);
+  if (!left_subtree && n_moved > config.refit_max_moved * particles.size()) {
+    sfc::generateKeys(config.key_type, particles.data(), particles.size(), key_universe.box);
+    std::sort(particles.begin(), particles.end());
+    buildLocalTree();
+  }
+  else resetNodeData(local_root);
+  finishBuild(part, cb);
+}
+
+template <typename Data>
+size_t Subtree<Data>::countMovedParticles(const BoundingBox& key_universe, bool& left_subtree) const {
+  // Those now in another leaf of this Subtree, which a local rebuild places
+  auto& config = paratreet::getConfiguration();
+  const int tp_shift = __builtin_clzll(tp_key);
+  size_t n_moved = 0;
+  for (auto leaf : leaves) {
+    const int shift = __builtin_clzll(leaf->key);
+    for (int i = 0; i < leaf->n_particles; i++) {
+      Key key = sfc::generateKey(config.key_type, leaf->particles()[i].position, key_universe.box)
+        | sfc::kPlaceholderBit;
+      bool in_subtree = (key >> tp_shift) == tp_key;
+      left_subtree |= !in_subtree;
+      n_moved += in_subtree && (key >> shift) != leaf->key;
+    }
+  }
+  return n_moved;
+}
+
+template <typename Data>
+void Subtree<Data>::resetNodeData(Node<Data>* node) {
+  node->requested = 0ull;
+  if (node->type == Node<Data>::Type::Leaf) {
+    node->data = Data(node->particles(), node->n_particles, node->depth);
+    return;
+  }
+  node->data = Data(); // Also what empty leaves are built with
+  node->wait_count = node->n_children;
+  for (int i = 0; i < node->n_children; i++) resetNodeData(node->getChild(i));
+}
+
+template <typename Data>
+void Subtree<Data>::finishBuild(CProxy_Partition<Data> part, CkCallback cb) {
+  auto& config = paratreet::getConfiguration();
+  // Work is counted afresh by this iteration's traversals
+  if (config.work_weighted) {
+    for (auto && p : particles) p.work = 1.;
+  }
+  // Leaf ranges are final once the build is done
+  if (config.soa_particles) {
+    hot_particles.assign(particles.data(), particles.size());
+    for (auto leaf : leaves) {
+      leaf->setHotParticles(&hot_particles, leaf->particles() - particles.data());
+    }
+  }
 
   flat_subtree.tp_index  = this->thisIndex;
   flat_subtree.cm_index  = cm_proxy.ckLocalBranch()->thisIndex;
-  flat_subtree.particles = particles;
+  flat_subtree.referenceParticles(particles.data(), particles.size());
 
   // Populate the tree structure (including TreeCanopy)
   populateTree();
-  thread_state_holder.ckLocalBranch()->countSubtreeParticles(particles.size());
+  auto tsh = thread_state_holder.ckLocalBranch();
+  tsh->countSubtreeParticles(particles.size());
+  numa::countPages(particles.data(), particles.size() * sizeof(Particle), numa::currentNode(), tsh->particle_pages);
+  node_pool->countPages(tsh->node_pages);
   initCache();
 
   this->contribute(cb);
@@ -335,7 +479,7 @@ void Subtree<Data>::recursiveBuild(Node<Data>* node, Particle* node_particles, s
     int n_particles = first_ge_idx - start;
 
     // Create child and store in vector
-    Node<Data>* child = cm_local->makeNode(child_key, getType(n_particles, config.max_particles_per_leaf),
+    Node<Data>* child = node_pool->alloc(child_key, getType(n_particles, config.max_particles_per_leaf),
         node->depth + 1, n_particles, node_particles + start, node, this->thisIndex, cm_local->thisIndex);
     node->exchangeChild(i, child);
 
@@ -399,6 +543,7 @@ void Subtree<Data>::requestNodes(Key key, int cm_index) {
 template <typename Data>
 void Subtree<Data>::reset() {
   particles.clear();
+  hot_particles.clear();
   flat_subtree.clear();
 }
 
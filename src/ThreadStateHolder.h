@@ -4,6 +4,7 @@
 #include "paratreet.decl.h"
 #include "common.h"
 #include "Particle.h"
+#include "NumaAlloc.h"
 
 class ThreadStateHolder : public CBase_ThreadStateHolder {
 public: // these need to be seen by other local chares
@@ -15,8 +16,12 @@ public: // these need to be seen by other local chares
   unsigned n_subtree_particles   = 0u;
   unsigned n_ps_copies           = 0u;
   unsigned n_ps_shares           = 0u;
+  // placement of particle arrays and node pools, sampled with libnuma
+  numa::PageStats particle_pages, node_pages;
 
   BoundingBox universe;
+  int active_rung = 0; // traversals only target leaves with particles on this rung or above
+  bool count_work = false; // traversals add their interactions to Particle::work
 
 private:
   std::map<int, std::map<Key, Particle::Effect>> opposing_effects; // (partition, pKey, effect)
@@ -29,10 +34,19 @@ public:
     universe = universe_;
   }
 
+  void setActiveRung(int active_rung_) {
+    active_rung = active_rung_;
+  }
+
+  void setCountWork(bool count_work_) {
+    count_work = count_work_;
+  }
+
   void reset() {
     n_part_ints = n_node_ints = n_opens = n_closes = 0ull;
     n_partition_particles = n_subtree_particles = 0u;
     n_ps_copies = n_ps_shares = 0;
+    particle_pages = node_pages = numa::PageStats();
     if (!opposing_effects.empty()) CkAbort("user added opposing effects but did not flush them");
   }
 
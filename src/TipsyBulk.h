@@ -0,0 +1,175 @@
+#ifndef PARATREET_TIPSYBULK_H_
+#define PARATREET_TIPSYBULK_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Bulk decoding of single-precision Tipsy files, native or standard
+// (big-endian XDR). Records are read with pread in large blocks and
+// byte-swapped a block at a time instead of one particle per call.
+// Files this does not recognize (other record layouts) report !ok(), so
+// callers can fall back to Tipsy::TipsyReader. No Charm++ dependency.
+namespace tipsyio {
+
+struct Header {
+  double time = 0;
+  int nbodies = 0;
+  int ndim = 0;
+  int nsph = 0;
+  int ndark = 0;
+  int nstar = 0;
+};
+
+// Records as stored, every field a 4-byte float
+struct GasRecord {
+  float mass, pos[3], vel[3], rho, temp, hsmooth, metals, phi;
+};
+
+struct DarkRecord {
+  float mass, pos[3], vel[3], eps, phi;
+};
+
+struct StarRecord {
+  float mass, pos[3], vel[3], metals, tform, eps, phi;
+};
+
+/// Reverses the bytes of n 32-bit words in place, a loop the compiler vectorizes
+inline void byteSwap(uint32_t* words, size_t n) {
+  for (size_t i = 0; i < n; i++) words[i] = __builtin_bswap32(words[i]);
+}
+
+class File {
+public:
+  /// block_bytes is the most read by one pread
+  explicit File(const std::string& path, size_t block_bytes = size_t(64) << 20)
+  : block_bytes(block_bytes)
+  {
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd >= 0) valid = readHeader();
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (valid) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  }
+  File(const File&) = delete;
+  File& operator=(const File&) = delete;
+  ~File() {
+    if (fd >= 0) close(fd);
+  }
+
+  bool ok() const {return valid;}
+  bool swapped() const {return swap;}
+  const Header& header() const {return h;}
+
+  /// Decodes particles [first, first + n) in file order (gas, then dark,
+  /// then star), calling gas(record, i), dark(record, i) or star(record, i)
+  /// with i counted from first. Returns false on a short read
+  template <typename GasFn, typename DarkFn, typename StarFn>
+  bool read(size_t first, size_t n, GasFn gas, DarkFn dark, StarFn star) {
+    const size_t end = first + n;
+    const size_t n_sph = h.nsph, n_dark = h.ndark, n_star = h.nstar;
+    const size_t dark_offset = header_bytes + n_sph * sizeof(GasRecord);
+    const size_t star_offset = dark_offset + n_dark * sizeof(DarkRecord);
+    auto clip = [&] (size_t begin, size_t count, size_t& from, size_t& to) {
+      from = std::max(first, begin);
+      to = std::min(end, begin + count);
+      return from < to;
+    };
+    size_t from, to;
+    if (clip(0, n_sph, from, to)) {
+      if (!readSection<GasRecord>(header_bytes, from, to, first, gas)) return false;
+    }
+    if (clip(n_sph, n_dark, from, to)) {
+      if (!readSection<DarkRecord>(dark_offset, from - n_sph, to - n_sph, first, dark, n_sph)) return false;
+    }
+    if (clip(n_sph + n_dark, n_star, from, to)) {
+      if (!readSection<StarRecord>(star_offset, from - n_sph - n_dark, to - n_sph - n_dark, first, star, n_sph + n_dark)) return false;
+    }
+    return true;
+  }
+
+private:
+  int fd = -1;
+  bool valid = false;
+  bool swap = false;
+  Header h;
+  size_t header_bytes = 0;
+  const size_t block_bytes;
+  std::vector<uint32_t> buffer;
+
+  bool preadAll(void* dest, size_t bytes, size_t offset) {
+    char* ptr = static_cast<char*>(dest);
+    while (bytes > 0) {
+      ssize_t got = pread(fd, ptr, bytes, offset);
+      if (got <= 0) return false;
+      ptr += got;
+      bytes -= got;
+      offset += got;
+    }
+    return true;
+  }
+
+  bool readHeader() {
+    unsigned char bytes[28];
+    if (!preadAll(bytes, sizeof(bytes), 0)) return false;
+    uint32_t ints[5];
+    std::memcpy(ints, bytes + 8, sizeof(ints));
+    uint64_t time_bits;
+    std::memcpy(&time_bits, bytes, sizeof(time_bits));
+    // ndim tells the byte order
+    if (ints[1] != 3) {
+      swap = true;
+      byteSwap(ints, 5);
+      time_bits = __builtin_bswap64(time_bits);
+      if (ints[1] != 3) return false;
+    }
+    std::memcpy(&h.time, &time_bits, sizeof(h.time));
+    h.nbodies = ints[0];
+    h.ndim = ints[1];
+    h.nsph = ints[2];
+    h.ndark = ints[3];
+    h.nstar = ints[4];
+    if (h.nbodies < 0 || h.nsph < 0 || h.ndark < 0 || h.nstar < 0) return false;
+    if (h.nbodies != h.nsph + h.ndark + h.nstar) return false;
+    // The header is padded to 32 bytes, explicitly in standard files and by
+    // the alignment of the double in native ones. Other sizes mean records
+    // this does not know (double precision positions, for one)
+    struct stat st;
+    if (fstat(fd, &st) != 0) return false;
+    size_t body = size_t(h.nsph) * sizeof(GasRecord) + size_t(h.ndark) * sizeof(DarkRecord)
+      + size_t(h.nstar) * sizeof(StarRecord);
+    if (size_t(st.st_size) == 32 + body) header_bytes = 32;
+    else if (size_t(st.st_size) == 28 + body) header_bytes = 28;
+    else return false;
+    return true;
+  }
+
+  /// Records [from, to) of the section at offset, which starts at particle
+  /// section_first of the file
+  template <typename Record, typename Fn>
+  bool readSection(size_t offset, size_t from, size_t to, size_t first, Fn fn, size_t section_first = 0) {
+    static_assert(sizeof(Record) % sizeof(uint32_t) == 0, "Tipsy records are 4-byte words");
+    constexpr size_t words = sizeof(Record) / sizeof(uint32_t);
+    const size_t block = std::max<size_t>(1, block_bytes / sizeof(Record));
+    buffer.resize(std::min(block, to - from) * words);
+    for (size_t begin = from; begin < to; begin += block) {
+      size_t count = std::min(block, to - begin);
+      if (!preadAll(buffer.data(), count * sizeof(Record), offset + begin * sizeof(Record))) return false;
+      if (swap) byteSwap(buffer.data(), count * words);
+      const Record* records = reinterpret_cast<const Record*>(buffer.data());
+      for (size_t i = 0; i < count; i++) fn(records[i], section_first + begin + i - first);
+    }
+    return true;
+  }
+};
+
+} // namespace tipsyio
+
+#endif // PARATREET_TIPSYBULK_H_
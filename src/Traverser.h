@@ -6,8 +6,10 @@
 #include <stack>
 #include <deque>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <bitset>
+#include <type_traits>
 
 namespace {
 
@@ -26,6 +28,7 @@ inline void doLeaf(Visitor& v, Node* source, Node* target, StatCollector* stats)
 #if COUNT_INTERACTIONS
   stats->countLeafInts(source->n_particles * target->n_particles);
 #endif
+  if (stats->count_work) target->addWork(source->n_particles);
 }
 
 template <typename Visitor, typename Node, typename StatCollector>
@@ -34,6 +37,7 @@ inline void doNode(Visitor& v, Node* source, Node* target, StatCollector* stats)
 #if COUNT_INTERACTIONS
   stats->countNodeInts(target->n_particles);
 #endif
+  if (stats->count_work) target->addWork(1);
 }
 
 template <typename Visitor, typename Node, typename StatCollector>
@@ -63,7 +67,10 @@ inline bool handleRemoteNode(Node<Data>* node, size_t trav_idx, size_t part_idx,
     }
     else {
       // The node is entirely remote, ask CacheManager for data
-      cm_proxy[node->cm_index].requestNodes(std::make_pair(node->key, cm_index));
+      if (paratreet::getConfiguration().request_batch_size > 1) {
+        r_proxy.ckLocalBranch()->requestNode(cm_proxy, node->cm_index, node->key, cm_index);
+      }
+      else cm_proxy[node->cm_index].requestNodes(std::make_pair(node->key, cm_index));
     }
   // it is possible that the node has been substituted already. in this case, check if the placeholder is still the same
   } else if (changed && node->parent && node->parent->getDescendant(node->key) != node) r_proxy.process(node->key);
@@ -86,6 +93,16 @@ public:
   virtual bool isFinished() = 0;
   virtual bool wantsPause() const {return false;}
   virtual void resumeAfterPause() {}
+
+protected:
+  // With config.traversal_slice_us, a traverser pauses once it has been
+  // running for that long instead of after a number of nodes or requests
+  double slice_end = 0;
+  void beginSlice() {
+    auto slice_us = paratreet::getConfiguration().traversal_slice_us;
+    slice_end = slice_us > 0 ? CkWallTimer() + slice_us * 1e-6 : 0;
+  }
+  bool sliceOver() const {return CkWallTimer() > slice_end;}
 };
 
 template <typename Data, typename Visitor>
@@ -114,6 +131,15 @@ protected:
     recurse(new_payload, all_leaves);
   }
 
+  // Called for every accepted (source, bucket) pair during the walk
+  virtual void emitLeaf(Node<Data>* source, int bucket) {
+    if (delay_leaf) interactions[bucket].push_back(source);
+    else doLeaf(v, source, leaves[bucket], stats);
+  }
+  virtual void emitNode(Node<Data>* source, int bucket) {
+    doNode(v, source, leaves[bucket], stats);
+  }
+
 public:
   TransposedDownTraverser(Visitor& vi, size_t ti, std::vector<Node<Data>*> leavesi, Partition<Data>& parti, bool delay_leafi = false)
     : v(vi), trav_idx(ti), leaves(leavesi), part(parti), delay_leaf(delay_leafi)
@@ -127,19 +153,24 @@ public:
   virtual bool isFinished() override {return curr_nodes.empty();}
   virtual void start() override {
     // Initialize with global root key and leaves
+    this->beginSlice();
     startTrav(part.cm_local->root);
   }
   virtual void interact() override {
     for (int i = 0; i < interactions.size(); i++) {
       for (Node<Data>* source : interactions[i]) {
-        doLeaf(v, source, part.leaves[i], stats);
+        doLeaf(v, source, leaves[i], stats);
       }
     }
   }
-  virtual bool wantsPause() const override {return handle_count > iter_pause_interval || num_requested > request_pause_interval;}
+  virtual bool wantsPause() const override {
+    if (this->slice_end > 0) return this->sliceOver();
+    return handle_count > iter_pause_interval || num_requested > request_pause_interval;
+  }
   virtual void resumeAfterPause() override{
     num_requested = 0;
     handle_count = 0;
+    this->beginSlice();
     size_t idx = 0u;
     for (; idx < paused_curr_nodes.size(); idx++) {
       if (wantsPause()) break;
@@ -165,8 +196,7 @@ public:
           // Store local and remote cached leaves for interactions
           for (int bucket = 0; bucket < leaves.size(); bucket++) {
             if (active_buckets[bucket] && (Visitor::CallSelfLeaf || leaves[bucket]->key != node->key)) {
-              if (delay_leaf) interactions[bucket].push_back(node);
-              else doLeaf(v, node, leaves[bucket], stats);
+              emitLeaf(node, bucket);
             }
           }
           break;
@@ -184,8 +214,7 @@ public:
             if (should_open) {
               continue_trav = true;
             } else {
-              // maybe delay as an interaction
-              doNode(v, node, leaves[bucket], stats);
+              emitNode(node, bucket);
             }
           }
           break;
@@ -218,6 +247,7 @@ public:
   virtual void resumeTrav() override {
     auto && resume_nodes = part.r_local->all_resume_nodes[std::make_pair(trav_idx, part.thisIndex)];
     CkAssert(!resume_nodes.empty()); // nothing to resume on?
+    this->beginSlice();
     while (!resume_nodes.empty()) {
       auto start_node = resume_nodes.front();
       resume_nodes.pop();
@@ -232,6 +262,58 @@ public:
   }
 };
 
+// Walks like TransposedDownTraverser but only records, per bucket, the
+// data of the accepted cells and the source leaves, by pointer like the
+// leaves themselves. The forces are evaluated afterwards in interact()
+// through the visitor's batch calls:
+//   void nodeBatch(const std::vector<const Data*>& cells, SpatialNode<Data>& target);
+//   void leafBatch(const std::vector<const SpatialNode<Data>*>& sources, SpatialNode<Data>& target);
+template <typename Data, typename Visitor>
+class InteractionListTraverser : public TransposedDownTraverser<Data, Visitor> {
+public:
+  struct InteractionList {
+    std::vector<const Data*> cells;
+    std::vector<const SpatialNode<Data>*> sources;
+  };
+
+private:
+  std::vector<InteractionList> lists;
+
+public:
+  InteractionListTraverser(Visitor& vi, size_t ti, std::vector<Node<Data>*> leavesi, Partition<Data>& parti)
+    : TransposedDownTraverser<Data, Visitor>(vi, ti, leavesi, parti)
+  {
+    lists.resize(this->leaves.size());
+  }
+  virtual ~InteractionListTraverser() = default;
+
+  virtual void interact() override {
+    for (int bucket = 0; bucket < lists.size(); bucket++) {
+      auto& list = lists[bucket];
+      auto& target = *this->leaves[bucket];
+      if (!list.cells.empty()) this->v.nodeBatch(list.cells, target);
+      if (!list.sources.empty()) this->v.leafBatch(list.sources, target);
+      list = InteractionList();
+    }
+  }
+
+protected:
+  virtual void emitLeaf(Node<Data>* source, int bucket) override {
+    lists[bucket].sources.push_back(source);
+#if COUNT_INTERACTIONS
+    this->stats->countLeafInts(source->n_particles * this->leaves[bucket]->n_particles);
+#endif
+    if (this->stats->count_work) this->leaves[bucket]->addWork(source->n_particles);
+  }
+  virtual void emitNode(Node<Data>* source, int bucket) override {
+    lists[bucket].cells.push_back(&source->data);
+#if COUNT_INTERACTIONS
+    this->stats->countNodeInts(this->leaves[bucket]->n_particles);
+#endif
+    if (this->stats->count_work) this->leaves[bucket]->addWork(1);
+  }
+};
+
 template <typename Data, typename Visitor>
 class BasicDownTraverser : public Traverser<Data> {
 protected:
@@ -271,18 +353,23 @@ public:
   virtual bool isFinished() override {return curr_nodes.empty();}
   virtual void start() override {
     // Initialize with global root key and leaves
+    this->beginSlice();
     startTrav();
   }
   virtual void interact() override {
     for (int i = 0; i < interactions.size(); i++) {
       for (Node<Data>* source : interactions[i]) {
-        doLeaf(v, source, part.leaves[i], stats);
+        doLeaf(v, source, leaves[i], stats);
       }
     }
   }
-  virtual bool wantsPause() const override {return saved_start_idx > next_stop_index || num_requested > request_pause_interval;}
+  virtual bool wantsPause() const override {
+    if (this->slice_end > 0) return this->sliceOver();
+    return saved_start_idx > next_stop_index || num_requested > request_pause_interval;
+  }
   virtual void resumeAfterPause() override {
     num_requested = 0;
+    this->beginSlice();
     auto iter_pause_interval = paratreet::getConfiguration().iter_pause_interval;
     next_stop_index += iter_pause_interval > 0 ? iter_pause_interval : leaves.size();
     startTrav();
@@ -344,6 +431,7 @@ public:
   virtual void resumeTrav() override {
     auto && resume_nodes = part.r_local->all_resume_nodes[std::make_pair(trav_idx, part.thisIndex)];
     CkAssert(!resume_nodes.empty()); // nothing to resume on?
+    this->beginSlice();
     while (!resume_nodes.empty()) {
       auto start_node = resume_nodes.front();
       resume_nodes.pop(); // TODO fix
@@ -371,8 +459,10 @@ private:
   std::vector<Node<Data>*> trav_tops;
 public:
   UpnDTraverser(Visitor& vi, size_t ti, Partition<Data>& parti) : v(vi), trav_idx(ti), part(parti) {
-    trav_tops.resize(part.leaves.size());
+    trav_tops.resize(part.leaves.size(), nullptr);
+    int active_rung = thread_state_holder.ckLocalBranch()->active_rung;
     for (int i = 0; i < part.leaves.size(); i++) {
+      if (active_rung > 0 && !part.leaves[i]->isActive(active_rung)) continue;
       auto tree_leaf = part.tree_leaves[i];
       curr_nodes[tree_leaf->key].push_back(i);
       trav_tops[i] = tree_leaf;
@@ -384,7 +474,7 @@ public:
   virtual bool isFinished() override {return curr_nodes.empty();}
   virtual void start() override {
     for (auto && trav_top : trav_tops) {
-      traverse(trav_top);
+      if (trav_top) traverse(trav_top);
     }
     resumeTrav();
   }
@@ -491,19 +581,62 @@ private:
   Subtree<Data>& tp;
   ThreadStateHolder* stats = nullptr;
   std::unordered_map<Key, std::vector<Node<Data>*>> curr_nodes; // source nodes to target nodes
+  std::unordered_set<Node<Data>*> inactive_targets; // no particle on the active rung below them
 public:
   DualTraverser(Visitor& vi, size_t ti, Subtree<Data>& tpi) : v(vi), trav_idx(ti), tp(tpi)
   {
     stats = thread_state_holder.ckLocalBranch();
+    if (stats->active_rung > 0) findInactiveTargets(tp.local_root, stats->active_rung);
   }
   void start() override {
     curr_nodes[1].push_back(tp.local_root);
     doTrav(tp.cm_local->root);
     // do work
   }
-  virtual void interact() override {}
+  virtual void interact() override {
+    passDown(std::integral_constant<bool, Visitor::UseLocalExpansion>());
+  }
   virtual bool isFinished() override {return curr_nodes.empty();}
 
+private:
+  // Returns if node has a particle on the active rung
+  bool findInactiveTargets(Node<Data>* node, int active_rung) {
+    bool active = false;
+    if (node->isLeaf()) active = node->isActive(active_rung);
+    else {
+      for (int i = 0; i < node->n_children; i++) {
+        active |= findInactiveTargets(node->getChild(i), active_rung);
+      }
+    }
+    if (!active) inactive_targets.insert(node);
+    return active;
+  }
+
+  void passDown(std::false_type) {}
+  // Downward pass for visitors that accumulate local expansions in node():
+  // shift each expansion into the children, evaluate it at the leaves
+  void passDown(std::true_type) {
+    std::stack<Node<Data>*> nodes;
+    nodes.push(tp.local_root);
+    while (!nodes.empty()) {
+      Node<Data>* node = nodes.top();
+      nodes.pop();
+      if (node->type == Node<Data>::Type::EmptyLeaf || inactive_targets.count(node)) continue;
+      if (node->isLeaf()) {
+        v.evalLocal(*node);
+        continue;
+      }
+      for (int i = 0; i < node->n_children; i++) {
+        Node<Data>* child = node->getChild(i);
+        if (child->type == Node<Data>::Type::EmptyLeaf) continue;
+        v.shiftLocal(*node, *child);
+        nodes.push(child);
+      }
+    }
+  }
+
+public:
+
   void runInvertedTraversal(Node<Data>* source_leaf, Node<Data>* target_node)
   {
     std::stack<Node<Data>*> nodes;
@@ -511,6 +644,7 @@ public:
     while (!nodes.empty()) {
       Node<Data>* node = nodes.top();
       nodes.pop();
+      if (inactive_targets.count(node)) continue;
       if (node->isLeaf()) {
         doLeaf(v, source_leaf, node, stats);
       } else {
@@ -547,14 +681,14 @@ public:
 #if DEBUG
       CkPrintf("tp %d, target key = %d, type = %d, source key = %d, type = %d, pe %d\n", tp.thisIndex, node->key, (int)node->type, curr_payload->key, (int)curr_payload->type, CkMyPe());
 #endif
-      if (curr_payload->type == Node<Data>::Type::EmptyLeaf) {
+      if (curr_payload->type == Node<Data>::Type::EmptyLeaf || inactive_targets.count(curr_payload)) {
         continue;
       }
       switch (node->type) {
         case Node<Data>::Type::Leaf:
         case Node<Data>::Type::CachedRemoteLeaf:
           {
-            if (curr_payload->isLeaf() || !Visitor::TargetMustBeLeaf) {
+            if (curr_payload->isLeaf()) {
               doLeaf(v, node, curr_payload, stats); // n2 calc
             } else runInvertedTraversal(node, curr_payload);
             break;
@@ -49,7 +49,10 @@ void TreeCanopy<Data>::recvProxies(TPHolder<Data> tp_holder, int tp_index_,
 
 template <typename Data>
 void TreeCanopy<Data>::recvData(SpatialNode<Data> child, int branch_factor) {
-  // Accumulate data received from Subtree or children TreeCanopies
+  // Accumulate data received from Subtree or children TreeCanopies. my_sn
+  // is still served by requestData after the last round, so it is only
+  // cleared when the next round starts
+  if (recv_count == 0) my_sn.data = Data();
   my_sn.data += child.data;
   my_sn.depth = child.depth - 1;
 